@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "Base64.h"
+
+#include <array>
+#include <cstdint>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TEXTTRACK_BASE64_NEON 1
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define TEXTTRACK_BASE64_SSSE3 1
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+constexpr uint8_t INVALID = 0xff;
+
+constexpr std::array<uint8_t, 256> DECODE_TABLE = []() {
+    std::array<uint8_t, 256> table{};
+    for (auto &value : table) {
+        value = INVALID;
+    }
+    constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (uint8_t i = 0; i != 64; ++i) {
+        table[static_cast<uint8_t>(alphabet[i])] = i;
+    }
+    return table;
+}();
+
+// Decodes whole groups of 4 characters plus a final group of 2 or 3; padding already removed
+bool decodeScalar(const uint8_t *src, std::size_t length, uint8_t *dest) {
+    std::size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        const uint32_t a = DECODE_TABLE[src[i]];
+        const uint32_t b = DECODE_TABLE[src[i + 1]];
+        const uint32_t c = DECODE_TABLE[src[i + 2]];
+        const uint32_t d = DECODE_TABLE[src[i + 3]];
+        if ((a | b | c | d) & 0x80) {
+            return false;
+        }
+        const uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+        *dest++ = static_cast<uint8_t>(bits >> 16);
+        *dest++ = static_cast<uint8_t>(bits >> 8);
+        *dest++ = static_cast<uint8_t>(bits);
+    }
+    const std::size_t rest = length - i;
+    if (rest >= 2) {
+        const uint32_t a = DECODE_TABLE[src[i]];
+        const uint32_t b = DECODE_TABLE[src[i + 1]];
+        const uint32_t c = rest == 3 ? DECODE_TABLE[src[i + 2]] : 0;
+        if ((a | b | c) & 0x80) {
+            return false;
+        }
+        const uint32_t bits = (a << 18) | (b << 12) | (c << 6);
+        *dest++ = static_cast<uint8_t>(bits >> 16);
+        if (rest == 3) {
+            *dest++ = static_cast<uint8_t>(bits >> 8);
+        }
+    }
+    return true;
+}
+
+#if TEXTTRACK_BASE64_NEON
+
+// Maps 16 characters to their 6-bit values and flags anything outside the alphabet in error
+inline uint8x16_t translateNeon(uint8x16_t c, uint8x16_t &error) {
+    const uint8x16_t upper = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('Z')));
+    const uint8x16_t lower = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('z')));
+    const uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+    const uint8x16_t plus = vceqq_u8(c, vdupq_n_u8('+'));
+    const uint8x16_t slash = vceqq_u8(c, vdupq_n_u8('/'));
+    uint8x16_t offset = vandq_u8(upper, vdupq_n_u8(static_cast<uint8_t>(-'A')));
+    offset = vorrq_u8(offset, vandq_u8(lower, vdupq_n_u8(static_cast<uint8_t>(26 - 'a'))));
+    offset = vorrq_u8(offset, vandq_u8(digit, vdupq_n_u8(static_cast<uint8_t>(52 - '0'))));
+    offset = vorrq_u8(offset, vandq_u8(plus, vdupq_n_u8(static_cast<uint8_t>(62 - '+'))));
+    offset = vorrq_u8(offset, vandq_u8(slash, vdupq_n_u8(static_cast<uint8_t>(63 - '/'))));
+    const uint8x16_t valid = vorrq_u8(vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, plus)), slash);
+    error = vorrq_u8(error, vmvnq_u8(valid));
+    return vaddq_u8(c, offset);
+}
+
+// 64 characters to 48 bytes at a time; returns the number of characters consumed
+std::size_t decodeBlocks(const uint8_t *src, std::size_t length, uint8_t *dest, std::size_t /*decodedSize*/) {
+    std::size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        const uint8x16x4_t in = vld4q_u8(src + i);
+        uint8x16_t error = vdupq_n_u8(0);
+        const uint8x16_t a = translateNeon(in.val[0], error);
+        const uint8x16_t b = translateNeon(in.val[1], error);
+        const uint8x16_t c = translateNeon(in.val[2], error);
+        const uint8x16_t d = translateNeon(in.val[3], error);
+        const uint64x2_t error64 = vreinterpretq_u64_u8(error);
+        if ((vgetq_lane_u64(error64, 0) | vgetq_lane_u64(error64, 1)) != 0) {
+            // Let the scalar code find and report it
+            break;
+        }
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(dest + i / 4 * 3, out);
+    }
+    return i;
+}
+
+#elif TEXTTRACK_BASE64_SSSE3
+
+// 16 characters to 12 bytes at a time, after W. Mula's pshufb based decoder.
+// Each store writes 16 bytes, so only go on while that stays within the output.
+std::size_t decodeBlocks(const uint8_t *src, std::size_t length, uint8_t *dest, std::size_t decodedSize) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2f);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    std::size_t i = 0;
+    for (; i + 16 <= length && i / 4 * 3 + 16 <= decodedSize; i += 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+        const __m128i loNibbles = _mm_and_si128(in, mask2F);
+        const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff) {
+            // Let the scalar code find and report it
+            break;
+        }
+        const __m128i eq2F = _mm_cmpeq_epi8(in, mask2F);
+        const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+        const __m128i values = _mm_add_epi8(in, roll);
+        const __m128i mergedPairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        const __m128i merged = _mm_madd_epi16(mergedPairs, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i / 4 * 3), _mm_shuffle_epi8(merged, pack));
+    }
+    return i;
+}
+
+#else
+
+std::size_t decodeBlocks(const uint8_t * /*src*/, std::size_t /*length*/, uint8_t * /*dest*/, std::size_t /*decodedSize*/) {
+    return 0;
+}
+
+#endif
+
+} // namespace
+
+bool getBase64DecodedSize(const char *input, std::size_t length, std::size_t &decodedSize) {
+    std::size_t padding = 0;
+    while (padding != length && input[length - 1 - padding] == '=') {
+        ++padding;
+    }
+    // Padding only ever completes the last group of 4
+    if (padding > 2 || (padding != 0 && length % 4 != 0)) {
+        return false;
+    }
+    const std::size_t characters = length - padding;
+    if (characters % 4 == 1) {
+        return false;
+    }
+    decodedSize = characters / 4 * 3 + (characters % 4 != 0 ? characters % 4 - 1 : 0);
+    return true;
+}
+
+bool decodeBase64(const char *input, std::size_t length, subttxrend::common::DataBuffer &output) {
+    std::size_t decodedSize = 0;
+    if (!getBase64DecodedSize(input, length, decodedSize)) {
+        return false;
+    }
+    while (length != 0 && input[length - 1] == '=') {
+        --length;
+    }
+    const std::size_t start = output.size();
+    output.resize(start + decodedSize);
+    const auto *src = reinterpret_cast<const uint8_t *>(input);
+    auto *dest = reinterpret_cast<uint8_t *>(output.data() + start);
+    const std::size_t done = decodeBlocks(src, length, dest, decodedSize);
+    if (!decodeScalar(src + done, length - done, dest + done / 4 * 3)) {
+        output.resize(start);
+        return false;
+    }
+    return true;
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <subttxrend/common/DataBuffer.hpp>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Number of bytes that decodeBase64 will produce for input, which is checked for length
+// and padding only. Returns false if it cannot be valid base64.
+bool getBase64DecodedSize(const char *input, std::size_t length, std::size_t &decodedSize);
+
+// Decodes standard base64 (RFC 4648 alphabet, with or without '=' padding, no whitespace)
+// and appends the bytes to output. Uses NEON or SSSE3 where the target has it.
+// Returns false on malformed input, in which case output is left with its original size.
+bool decodeBase64(const char *input, std::size_t length, subttxrend::common::DataBuffer &output);
+
+} // namespace Plugin
+} // namespace WPEFramework
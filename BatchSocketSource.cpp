@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "BatchSocketSource.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+// Packet header up to and including the size word; the size counts the bytes after it
+constexpr std::size_t PACKET_SIZE_END = 12;
+// Datagrams per recvmmsg
+constexpr std::size_t BATCH_SIZE = 32;
+// Room for the largest PES packet and its header. The slots are anonymous memory that the
+// kernel only backs where a datagram was written, so small packets keep them cheap.
+constexpr std::size_t SLOT_SIZE = 128 * 1024;
+// Part of each slot that stays backed after use. What larger datagrams needed beyond it is given
+// back when the socket runs dry or a batch without them comes along, so that big packets don't
+// keep the whole batch resident, and a burst of them doesn't fault the pages in every time.
+constexpr std::size_t SLOT_RESIDENT_SIZE = 16 * 1024;
+
+} // namespace
+
+BatchSocketSource::BatchSocketSource(std::string path, DataBufferPool &pool, RenderWorkerPool *workers)
+    : mLogger("App", "BatchSocketSource", this), mPath(std::move(path)), mPool(pool), mWorkers(workers) {
+    mBatch.reserve(BATCH_SIZE);
+    mSlotUsed.assign(BATCH_SIZE, 0);
+}
+
+BatchSocketSource::~BatchSocketSource() {
+    stop();
+}
+
+void BatchSocketSource::start(subttxrend::socksrc::PacketReceiver *receiver) {
+    if (mThread.joinable() || mWatched) {
+        return;
+    }
+    if (!openSocket()) {
+        closeSocket();
+        receiver->onStreamBroken();
+        return;
+    }
+    if (mWorkers) {
+        // Level triggered, so reading one batch per call leaves the rest for the next one
+        mWatched = mWorkers->addFd(mSocket, [this, receiver]() { return readBatch(receiver) != ReadResult::FAILED; });
+        if (!mWatched) {
+            closeSocket();
+            receiver->onStreamBroken();
+        }
+        return;
+    }
+    mQuit = false;
+    mThread = std::thread(&BatchSocketSource::readLoop, this, receiver);
+}
+
+void BatchSocketSource::stop() {
+    if (mWatched) {
+        mWorkers->removeFd(mSocket);
+        mWatched = false;
+        closeSocket();
+        return;
+    }
+    if (!mThread.joinable()) {
+        return;
+    }
+    mQuit = true;
+    const uint64_t one = 1;
+    if (write(mStopEvent, &one, sizeof(one)) != sizeof(one)) {
+        mLogger.oserror(__LOGGER_FUNC__, " - cannot signal the read thread, errno=", errno);
+    }
+    mThread.join();
+    closeSocket();
+}
+
+bool BatchSocketSource::openSocket() {
+    struct sockaddr_un address {};
+    if (mPath.size() >= sizeof(address.sun_path)) {
+        mLogger.oserror(__LOGGER_FUNC__, " - socket path too long: ", mPath);
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, mPath.c_str(), sizeof(address.sun_path) - 1);
+    // A leftover from a crashed instance would otherwise make bind fail
+    unlink(mPath.c_str());
+    mSocket = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (mSocket < 0 || bind(mSocket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+        mLogger.oserror(__LOGGER_FUNC__, " - cannot bind ", mPath, ", errno=", errno);
+        return false;
+    }
+    mStopEvent = eventfd(0, EFD_CLOEXEC);
+    if (mStopEvent < 0) {
+        mLogger.oserror(__LOGGER_FUNC__, " - eventfd failed, errno=", errno);
+        return false;
+    }
+    void *const slots = mmap(nullptr, BATCH_SIZE * SLOT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slots == MAP_FAILED) {
+        mLogger.oserror(__LOGGER_FUNC__, " - mmap failed, errno=", errno);
+        return false;
+    }
+    mSlots = static_cast<char *>(slots);
+    mLogger.osinfo(__LOGGER_FUNC__, " - listening on ", mPath);
+    return true;
+}
+
+void BatchSocketSource::closeSocket() {
+    if (mSlots) {
+        munmap(mSlots, BATCH_SIZE * SLOT_SIZE);
+        mSlots = nullptr;
+        std::fill(mSlotUsed.begin(), mSlotUsed.end(), 0);
+    }
+    if (mStopEvent >= 0) {
+        ::close(mStopEvent);
+        mStopEvent = -1;
+    }
+    if (mSocket >= 0) {
+        ::close(mSocket);
+        mSocket = -1;
+    }
+}
+
+void BatchSocketSource::readLoop(subttxrend::socksrc::PacketReceiver *receiver) {
+    std::array<struct pollfd, 2> events{{{mSocket, POLLIN, 0}, {mStopEvent, POLLIN, 0}}};
+    while (!mQuit) {
+        switch (readBatch(receiver)) {
+            case ReadResult::PACKETS:
+                break;
+            case ReadResult::EMPTY:
+                if (poll(events.data(), events.size(), -1) < 0 && errno != EINTR) {
+                    mLogger.oserror(__LOGGER_FUNC__, " - poll failed, errno=", errno);
+                    receiver->onStreamBroken();
+                    return;
+                }
+                break;
+            case ReadResult::FAILED:
+                return;
+        }
+    }
+}
+
+BatchSocketSource::ReadResult BatchSocketSource::readBatch(subttxrend::socksrc::PacketReceiver *receiver) {
+    std::array<struct iovec, BATCH_SIZE> slots{};
+    std::array<struct mmsghdr, BATCH_SIZE> messages{};
+    for (std::size_t i = 0; i != BATCH_SIZE; ++i) {
+        slots[i].iov_base = mSlots + i * SLOT_SIZE;
+        slots[i].iov_len = SLOT_SIZE;
+        messages[i].msg_hdr.msg_iov = &slots[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    const int received = recvmmsg(mSocket, messages.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            releaseSlots();
+            return ReadResult::EMPTY;
+        }
+        mLogger.oserror(__LOGGER_FUNC__, " - recvmmsg failed, errno=", errno);
+        receiver->onStreamBroken();
+        return ReadResult::FAILED;
+    }
+    bool large = false;
+    for (int i = 0; i != received; ++i) {
+        // A truncated datagram filled its slot
+        const bool truncated = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        const std::size_t used = truncated ? SLOT_SIZE : messages[i].msg_len;
+        if (used > SLOT_RESIDENT_SIZE) {
+            mSlotUsed[i] = std::max(mSlotUsed[i], used);
+            large = true;
+        }
+        if (truncated) {
+            mLogger.oserror(__LOGGER_FUNC__, " - datagram larger than ", SLOT_SIZE, " bytes, dropped");
+            continue;
+        }
+        addPackets(mSlots + i * SLOT_SIZE, messages[i].msg_len);
+    }
+    if (!large) {
+        releaseSlots();
+    }
+    if (auto *const batchReceiver = dynamic_cast<BatchPacketReceiver *>(receiver)) {
+        batchReceiver->addBuffers(mBatch);
+    } else {
+        for (auto &buffer : mBatch) {
+            receiver->addBuffer(std::move(buffer));
+        }
+    }
+    mBatch.clear();
+    return ReadResult::PACKETS;
+}
+
+void BatchSocketSource::releaseSlots() {
+    for (std::size_t i = 0; i != BATCH_SIZE; ++i) {
+        if (mSlotUsed[i] != 0) {
+            madvise(mSlots + i * SLOT_SIZE + SLOT_RESIDENT_SIZE, mSlotUsed[i] - SLOT_RESIDENT_SIZE, MADV_DONTNEED);
+            mSlotUsed[i] = 0;
+        }
+    }
+}
+
+void BatchSocketSource::addPackets(const char *data, std::size_t size) {
+    while (size >= PACKET_SIZE_END) {
+        uint32_t payloadSize = 0;
+        std::memcpy(&payloadSize, data + PACKET_SIZE_END - sizeof(payloadSize), sizeof(payloadSize));
+        const std::size_t packetSize = PACKET_SIZE_END + static_cast<std::size_t>(payloadSize);
+        if (packetSize > size) {
+            break;
+        }
+        auto buffer = mPool.acquire(packetSize);
+        buffer->assign(data, data + packetSize);
+        mBatch.push_back(std::move(buffer));
+        data += packetSize;
+        size -= packetSize;
+    }
+    if (size != 0) {
+        mLogger.oserror(__LOGGER_FUNC__, " - incomplete packet, dropping ", size, " bytes");
+    }
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <subttxrend/common/Logger.hpp>
+#include <subttxrend/socksrc/PacketReceiver.hpp>
+#include <subttxrend/socksrc/Source.hpp>
+#include <thread>
+#include <vector>
+
+#include "DataBufferPool.h"
+#include "RenderWorkerPool.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+// A PacketReceiver that can take a number of packets at once
+class BatchPacketReceiver : public subttxrend::socksrc::PacketReceiver {
+public:
+    // Takes over all buffers; the vector is left empty for reuse
+    virtual void addBuffers(std::vector<subttxrend::common::DataBufferPtr> &buffers) = 0;
+};
+
+// Drop-in for socksrc::UnixSocketSource, reading the same datagram socket with recvmmsg so that
+// a burst of packets costs one system call and one hand-over instead of one each. A datagram
+// may hold several packets back to back; each is copied once, into a buffer from the pool.
+// Receivers that are not a BatchPacketReceiver get the packets one addBuffer at a time.
+// Given a RenderWorkerPool, the socket is read by its workers instead of a thread of its own.
+class BatchSocketSource : public subttxrend::socksrc::Source {
+public:
+    BatchSocketSource(std::string path, DataBufferPool &pool, RenderWorkerPool *workers = nullptr);
+    ~BatchSocketSource() override;
+    BatchSocketSource(const BatchSocketSource &) = delete;
+    BatchSocketSource &operator=(const BatchSocketSource &) = delete;
+
+    // Creates the socket before returning, unlike UnixSocketSource; reports onStreamBroken if it cannot
+    void start(subttxrend::socksrc::PacketReceiver *receiver) override;
+    void stop() override;
+private:
+    bool openSocket();
+    void closeSocket();
+    void readLoop(subttxrend::socksrc::PacketReceiver *receiver);
+    enum class ReadResult {
+        PACKETS,
+        EMPTY,
+        FAILED
+    };
+    // One recvmmsg without waiting, handing over what it got; reports onStreamBroken on FAILED
+    ReadResult readBatch(subttxrend::socksrc::PacketReceiver *receiver);
+    // Splits one datagram into packets and appends them to mBatch
+    void addPackets(const char *data, std::size_t size);
+    // Gives back the pages of the slots beyond what small datagrams need
+    void releaseSlots();
+
+    subttxrend::common::Logger mLogger;
+    const std::string mPath;
+    DataBufferPool &mPool;
+    RenderWorkerPool *const mWorkers;
+    // Whether mWorkers is watching mSocket
+    bool mWatched = false;
+    int mSocket = -1;
+    // Signalled by stop
+    int mStopEvent = -1;
+    // Receive slots for recvmmsg, see readLoop
+    char *mSlots = nullptr;
+    // Bytes written to each slot since releaseSlots, where more than stays backed anyway; 0 otherwise
+    std::vector<std::size_t> mSlotUsed;
+    std::vector<subttxrend::common::DataBufferPtr> mBatch;
+    std::atomic<bool> mQuit{false};
+    std::thread mThread;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
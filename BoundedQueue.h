@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Fixed-capacity lock-free queue (D. Vyukov's bounded MPMC design).
+// Each cell carries a sequence number telling whether it is ready to be written or read
+// for a given lap around the ring, so producers and consumers only contend on a single
+// compare-exchange of their own position. The capacity is rounded up to a power of two.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) : mMask(roundUp(capacity) - 1), mCells(new Cell[mMask + 1]) {
+        for (std::size_t i = 0; i <= mMask; ++i) {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    std::size_t capacity() const {
+        return mMask + 1;
+    }
+
+    // Moves value into the queue and returns true, or leaves value untouched and returns false when full
+    bool tryPush(T &value) {
+        Cell *cell;
+        std::size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &mCells[pos & mMask];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Moves the oldest element into value and returns true, or returns false when empty
+    bool tryPop(T &value) {
+        Cell *cell;
+        std::size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &mCells[pos & mMask];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(pos + mMask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only a snapshot when other threads are pushing or popping
+    bool empty() const {
+        return mDequeuePos.load(std::memory_order_acquire) == mEnqueuePos.load(std::memory_order_acquire);
+    }
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+    static std::size_t roundUp(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    const std::size_t mMask;
+    const std::unique_ptr<Cell[]> mCells;
+    // Kept on separate cache lines, as producers and consumer update them independently
+    alignas(64) std::atomic<std::size_t> mEnqueuePos{0};
+    alignas(64) std::atomic<std::size_t> mDequeuePos{0};
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "ByteRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+std::size_t roundUp(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+} // namespace
+
+ByteRing::ByteRing(std::size_t capacity) : mMask(roundUp(capacity) - 1), mData(new char[mMask + 1]) {}
+
+bool ByteRing::write(const void *data, std::size_t size) {
+    const std::size_t writePosition = mWritePosition.load(std::memory_order_relaxed);
+    const std::size_t readPosition = mReadPosition.load(std::memory_order_acquire);
+    if (size > mMask + 1 - (writePosition - readPosition)) {
+        return false;
+    }
+    const std::size_t offset = writePosition & mMask;
+    const std::size_t first = std::min(size, mMask + 1 - offset);
+    std::memcpy(mData.get() + offset, data, first);
+    std::memcpy(mData.get(), static_cast<const char *>(data) + first, size - first);
+    mWritePosition.store(writePosition + size, std::memory_order_release);
+    return true;
+}
+
+std::size_t ByteRing::readAll(subttxrend::common::DataBuffer &output) {
+    const std::size_t readPosition = mReadPosition.load(std::memory_order_relaxed);
+    const std::size_t size = mWritePosition.load(std::memory_order_acquire) - readPosition;
+    const std::size_t offset = readPosition & mMask;
+    const std::size_t first = std::min(size, mMask + 1 - offset);
+    output.insert(output.end(), mData.get() + offset, mData.get() + offset + first);
+    output.insert(output.end(), mData.get(), mData.get() + (size - first));
+    mReadPosition.store(readPosition + size, std::memory_order_release);
+    return size;
+}
+
+void ByteRing::clear() {
+    mReadPosition.store(mWritePosition.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+std::size_t ByteRing::size() const {
+    return mWritePosition.load(std::memory_order_acquire) - mReadPosition.load(std::memory_order_acquire);
+}
+
+bool ByteRing::empty() const {
+    return size() == 0;
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <subttxrend/common/DataBuffer.hpp>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Fixed-capacity ring of bytes for one producer and one consumer thread, without locks or
+// allocations after construction. Writes are all or nothing, so records written whole are
+// read back whole. The capacity is rounded up to a power of two.
+class ByteRing {
+public:
+    explicit ByteRing(std::size_t capacity);
+    ByteRing(const ByteRing &) = delete;
+    ByteRing &operator=(const ByteRing &) = delete;
+
+    // Producer: appends size bytes and returns true, or returns false if there is not enough room
+    bool write(const void *data, std::size_t size);
+    // Consumer: appends everything written so far to output and returns the number of bytes
+    std::size_t readAll(subttxrend::common::DataBuffer &output);
+    // Consumer: discards everything written so far
+    void clear();
+    // Only a snapshot when the other side is active
+    std::size_t size() const;
+    bool empty() const;
+private:
+    const std::size_t mMask;
+    const std::unique_ptr<char[]> mData;
+    // Kept on separate cache lines, as producer and consumer update them independently
+    alignas(64) std::atomic<std::size_t> mWritePosition{0};
+    alignas(64) std::atomic<std::size_t> mReadPosition{0};
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
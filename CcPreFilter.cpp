@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "CcPreFilter.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+constexpr uint8_t CC_VALID = 0x04;
+constexpr uint8_t CC_TYPE_MASK = 0x03;
+// cc_type values 0 and 1 carry CEA-608 field 1 and 2; 2 and 3 are CEA-708
+constexpr uint8_t CC_TYPE_608_FIELD_2 = 1;
+
+bool hasOddParity(uint8_t byte) {
+    return __builtin_parity(byte) != 0;
+}
+
+uint8_t *writeTriplet(uint8_t *output, const uint8_t *triplet) {
+    output[0] = triplet[0];
+    output[1] = triplet[1];
+    output[2] = triplet[2];
+    return output + 3;
+}
+
+} // namespace
+
+std::size_t CcPreFilter::filter(const uint8_t *input, std::size_t size, uint8_t *output) {
+    uint8_t *out = output;
+    for (std::size_t i = 0; i + 3 <= size; i += 3) {
+        const uint8_t *triplet = input + i;
+        const uint8_t ccType = triplet[0] & CC_TYPE_MASK;
+        if (ccType > CC_TYPE_608_FIELD_2) {
+            out = writeTriplet(out, triplet);
+            continue;
+        }
+        if ((triplet[0] & CC_VALID) == 0) {
+            continue;
+        }
+        FieldState &field = mFields[ccType];
+        const uint8_t first = triplet[1] & 0x7f;
+        const uint8_t second = triplet[2] & 0x7f;
+        if (first == 0 && second == 0) {
+            // Padding; decoders look through it
+            continue;
+        }
+        if (first < 0x10 || first >= 0x20) {
+            // Characters, or XDS on field 2; both end a run of control codes
+            field.inputControl = 0;
+            field.outputControl = 0;
+            out = writeTriplet(out, triplet);
+            continue;
+        }
+        if (!hasOddParity(triplet[1]) || !hasOddParity(triplet[2])) {
+            // A control code must not run on a bit error
+            continue;
+        }
+        const uint16_t control = static_cast<uint16_t>(first << 8 | second);
+        if (control == field.inputControl) {
+            // The redundant copy
+            field.inputControl = 0;
+            continue;
+        }
+        field.inputControl = control;
+        if (control == field.outputControl) {
+            // Would be taken for the redundant copy of the previous one
+            out = writeTriplet(out, triplet);
+        }
+        out = writeTriplet(out, triplet);
+        field.outputControl = control;
+    }
+    return static_cast<std::size_t>(out - output);
+}
+
+void CcPreFilter::reset() {
+    mFields = {};
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Thins out the CEA-608 part of cc_data() triplets before they are queued. It drops padding,
+// invalid pairs, control codes that fail their parity check, and the second copy of control
+// codes, which CEA-608 sends twice.
+//
+// Decoders ignore a control code that repeats the one just before it, looking through
+// padding, and the next repeat counts again. The output keeps that working: when a control
+// code is to run right after the same one in the output, it is written twice. CEA-708
+// triplets pass through as they are.
+class CcPreFilter {
+public:
+    // Room output needs beyond the input size: one extra pair per field
+    static constexpr std::size_t MAX_GROWTH = 6;
+
+    // Filters size bytes of triplets from input into output, which must have room for
+    // size + MAX_GROWTH bytes, and returns the output size. Keeps state across calls.
+    std::size_t filter(const uint8_t *input, std::size_t size, uint8_t *output);
+    // Forgets the state, as when the decoder is reset
+    void reset();
+private:
+    struct FieldState {
+        // Control code the decoder ran last and would ignore once more, 0 if none
+        uint16_t inputControl = 0;
+        // The same for the decoder fed with our output
+        uint16_t outputControl = 0;
+    };
+    std::array<FieldState, 2> mFields;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "DataBufferPool.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+subttxrend::common::DataBufferPtr DataBufferPool::acquire(std::size_t capacity) {
+    for (std::size_t i = 0; i != NUM_CLASSES; ++i) {
+        if (capacity <= CLASS_CAPACITY[i]) {
+            std::lock_guard<std::mutex> lock{mMutex};
+            if (!mFree[i].empty()) {
+                auto buffer = std::move(mFree[i].back());
+                mFree[i].pop_back();
+                return buffer;
+            }
+            break;
+        }
+    }
+    // Nothing to reuse. Most buffers end up owned by a parsed packet and are never released,
+    // so reserve only what was asked for rather than the whole class.
+    subttxrend::common::DataBufferPtr buffer(new subttxrend::common::DataBuffer);
+    buffer->reserve(capacity);
+    return buffer;
+}
+
+void DataBufferPool::release(subttxrend::common::DataBufferPtr buffer) {
+    if (!buffer) {
+        return;
+    }
+    // File it under the biggest class it can fully serve
+    for (std::size_t i = NUM_CLASSES; i-- != 0;) {
+        if (buffer->capacity() >= CLASS_CAPACITY[i]) {
+            // Don't let a huge buffer occupy a slot meant for a much smaller class
+            if (buffer->capacity() > 2 * CLASS_CAPACITY[i]) {
+                return;
+            }
+            buffer->clear();
+            std::lock_guard<std::mutex> lock{mMutex};
+            if (mFree[i].size() < CLASS_LIMIT[i]) {
+                mFree[i].emplace_back(std::move(buffer));
+            }
+            return;
+        }
+    }
+}
+
+void DataBufferPool::trim() {
+    std::lock_guard<std::mutex> lock{mMutex};
+    for (auto &buffers : mFree) {
+        buffers.clear();
+    }
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
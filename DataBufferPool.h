@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <subttxrend/common/DataBuffer.hpp>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Keeps released DataBuffers around for reuse, sorted into a few size classes by capacity.
+// A released buffer is handed out again for any request up to the capacity of its class, so
+// filling it up to the requested capacity never reallocates. When the class has nothing to
+// reuse a new buffer of exactly the requested capacity is allocated. Buffers larger than the
+// largest class are allocated and freed as usual. The number of buffers kept per class is capped, which
+// bounds the memory a pool can hold on to.
+class DataBufferPool {
+public:
+    DataBufferPool() = default;
+    DataBufferPool(const DataBufferPool &) = delete;
+    DataBufferPool &operator=(const DataBufferPool &) = delete;
+
+    // Returns an empty buffer with at least the given capacity; a new one is not rounded up to its class
+    subttxrend::common::DataBufferPtr acquire(std::size_t capacity);
+    // Hands a buffer back for reuse; it is freed if its class is full or it is too small/big
+    void release(subttxrend::common::DataBufferPtr buffer);
+    // Frees all buffers kept for reuse
+    void trim();
+private:
+    static constexpr std::size_t NUM_CLASSES = 4;
+    // Capacity of each class and how many buffers of that class we keep at most
+    static constexpr std::array<std::size_t, NUM_CLASSES> CLASS_CAPACITY{256, 4 * 1024, 64 * 1024, 1024 * 1024};
+    static constexpr std::array<std::size_t, NUM_CLASSES> CLASS_LIMIT{16, 8, 4, 1};
+
+    std::mutex mMutex;
+    // Protected by mMutex
+    std::array<std::vector<subttxrend::common::DataBufferPtr>, NUM_CLASSES> mFree;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "Decompression.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+
+#if TEXTTRACK_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+constexpr std::size_t MIN_GROWTH = 4096;
+
+// Makes room for more output: first whatever capacity is left, then half as much again
+bool growOutput(subttxrend::common::DataBuffer &output, std::size_t used, std::size_t maxSize) {
+    if (used == maxSize) {
+        return false;
+    }
+    std::size_t size = output.capacity() > used ? output.capacity() : used + std::max(MIN_GROWTH, used / 2);
+    output.resize(std::min(size, maxSize));
+    return true;
+}
+
+bool inflateZlib(const char *input, std::size_t length, subttxrend::common::DataBuffer &output, std::size_t maxSize) {
+    const std::size_t start = output.size();
+    z_stream stream{};
+    // 32 makes zlib detect a zlib or gzip header
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input));
+    stream.avail_in = static_cast<uInt>(length);
+    std::size_t used = start;
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        if (used == output.size() && !growOutput(output, used, start + maxSize)) {
+            break;
+        }
+        stream.next_out = reinterpret_cast<Bytef *>(output.data() + used);
+        stream.avail_out = static_cast<uInt>(output.size() - used);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        used = output.size() - stream.avail_out;
+    }
+    inflateEnd(&stream);
+    if (ret != Z_STREAM_END) {
+        output.resize(start);
+        return false;
+    }
+    output.resize(used);
+    return true;
+}
+
+#if TEXTTRACK_WITH_ZSTD
+bool decompressZstd(const char *input, std::size_t length, subttxrend::common::DataBuffer &output, std::size_t maxSize) {
+    const std::size_t start = output.size();
+    const unsigned long long contentSize = ZSTD_getFrameContentSize(input, length);
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR || (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize > maxSize)) {
+        return false;
+    }
+    if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN) {
+        output.resize(start + contentSize);
+        const std::size_t ret = ZSTD_decompress(output.data() + start, contentSize, input, length);
+        if (ZSTD_isError(ret) || ret != contentSize) {
+            output.resize(start);
+            return false;
+        }
+        return true;
+    }
+    // The writer did not record the size, so stream it
+    ZSTD_DCtx *const context = ZSTD_createDCtx();
+    if (!context) {
+        return false;
+    }
+    ZSTD_inBuffer in{input, length, 0};
+    std::size_t used = start;
+    std::size_t ret = 1;
+    while (ret != 0) {
+        if (used == output.size() && !growOutput(output, used, start + maxSize)) {
+            break;
+        }
+        ZSTD_outBuffer out{output.data(), output.size(), used};
+        ret = ZSTD_decompressStream(context, &out, &in);
+        used = out.pos;
+        if (ZSTD_isError(ret) || (ret != 0 && in.pos == in.size && out.pos < out.size)) {
+            // Broken or truncated frame
+            break;
+        }
+    }
+    ZSTD_freeDCtx(context);
+    if (ret != 0) {
+        output.resize(start);
+        return false;
+    }
+    output.resize(used);
+    return true;
+}
+#endif
+
+} // namespace
+
+bool isCompressionSupported(Compression compression) {
+    switch (compression) {
+        case Compression::NONE:
+        case Compression::ZLIB:
+            return true;
+        case Compression::ZSTD:
+#if TEXTTRACK_WITH_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool decompress(Compression compression, const char *input, std::size_t length, subttxrend::common::DataBuffer &output, std::size_t maxSize) {
+    switch (compression) {
+        case Compression::NONE:
+            if (length > maxSize) {
+                return false;
+            }
+            output.insert(output.end(), input, input + length);
+            return true;
+        case Compression::ZLIB:
+            return inflateZlib(input, length, output, maxSize);
+        case Compression::ZSTD:
+#if TEXTTRACK_WITH_ZSTD
+            return decompressZstd(input, length, output, maxSize);
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <subttxrend/common/DataBuffer.hpp>
+
+namespace WPEFramework {
+namespace Plugin {
+
+enum class Compression {
+    NONE,
+    // zlib or gzip stream
+    ZLIB,
+    // zstd frame, only with TEXTTRACK_WITH_ZSTD
+    ZSTD
+};
+
+// Whether this build can decompress the given compression
+bool isCompressionSupported(Compression compression);
+
+// Decompresses input and appends the result to output, using its spare capacity first.
+// Fails on malformed input or if the result would be larger than maxSize. On failure,
+// output is left with its original size.
+bool decompress(Compression compression, const char *input, std::size_t length, subttxrend::common::DataBuffer &output, std::size_t maxSize);
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "Doorbell.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <ctime>
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+int64_t currentSecond() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+void Doorbell::ring(Priority priority) {
+    // Pairs with the fence in arm: either the waiter sees the new work or we see it armed
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t state = mState.load(std::memory_order_relaxed);
+    while (state == ARMED || (state == ARMED_URGENT && priority == Priority::URGENT)) {
+        if (mState.compare_exchange_weak(state, RUNG, std::memory_order_release, std::memory_order_relaxed)) {
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&mState), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+            return;
+        }
+    }
+}
+
+void Doorbell::arm(Priority minPriority) {
+    mState.store(minPriority == Priority::URGENT ? ARMED_URGENT : ARMED, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Doorbell::sleep(std::chrono::milliseconds timeout) {
+    const uint32_t state = mState.load(std::memory_order_relaxed);
+    if (state != RUNG) {
+        struct timespec relative {};
+        if (timeout != FOREVER) {
+            relative.tv_sec = timeout.count() / 1000;
+            relative.tv_nsec = timeout.count() % 1000 * 1000 * 1000;
+        }
+        // Returns at once if a ring got in since the load
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&mState), FUTEX_WAIT_PRIVATE, state, timeout != FOREVER ? &relative : nullptr, nullptr, 0);
+    }
+    if (mState.exchange(IDLE, std::memory_order_acquire) == RUNG) {
+        countWakeup();
+    }
+}
+
+void Doorbell::countWakeup() {
+    const int64_t second = currentSecond();
+    const int64_t last = mWakeupSecond.load(std::memory_order_relaxed);
+    if (second != last) {
+        mPreviousWakeups.store(second == last + 1 ? mWakeups.load(std::memory_order_relaxed) : 0, std::memory_order_relaxed);
+        mWakeups.store(0, std::memory_order_relaxed);
+        mWakeupSecond.store(second, std::memory_order_relaxed);
+    }
+    mWakeups.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t Doorbell::getWakeupsPerSecond() const {
+    const int64_t second = currentSecond();
+    const int64_t last = mWakeupSecond.load(std::memory_order_relaxed);
+    if (second == last) {
+        return mPreviousWakeups.load(std::memory_order_relaxed);
+    }
+    // The waiter has not been woken since, so that second is complete
+    return second == last + 1 ? mWakeups.load(std::memory_order_relaxed) : 0;
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
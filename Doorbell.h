@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Wakes up a single waiting thread, coalescing rings so that only the first one after the
+// waiter went to sleep makes a system call. Everything else costs a fence and a load.
+//
+// The waiter arms the doorbell, checks once more for work and only then sleeps on the
+// futex, so a ring that lands in between is never lost. Waiting for URGENT only lets
+// NORMAL rings pass without waking the waiter.
+class Doorbell {
+public:
+    enum class Priority {
+        NORMAL,
+        URGENT
+    };
+    static constexpr std::chrono::milliseconds FOREVER = std::chrono::milliseconds::max();
+
+    Doorbell() = default;
+    Doorbell(const Doorbell &) = delete;
+    Doorbell &operator=(const Doorbell &) = delete;
+
+    // Wakes the waiter if it waits for rings of this priority; call after making the work visible
+    void ring(Priority priority);
+    // Sleeps until a ring of at least minPriority or the timeout, unless hasWork() is true once armed.
+    // May return early without either; the caller is expected to check for work again.
+    template <typename HasWork>
+    void wait(Priority minPriority, std::chrono::milliseconds timeout, HasWork hasWork) {
+        arm(minPriority);
+        if (hasWork()) {
+            mState.store(IDLE, std::memory_order_relaxed);
+            return;
+        }
+        sleep(timeout);
+    }
+    // Times the waiter was actually woken up by a ring in the last full second
+    uint32_t getWakeupsPerSecond() const;
+private:
+    enum : uint32_t {
+        IDLE,
+        ARMED,
+        ARMED_URGENT,
+        RUNG
+    };
+    void arm(Priority minPriority);
+    void sleep(std::chrono::milliseconds timeout);
+    void countWakeup();
+
+    // The futex word
+    std::atomic<uint32_t> mState{IDLE};
+    // Only written by the waiter
+    std::atomic<int64_t> mWakeupSecond{0};
+    std::atomic<uint32_t> mWakeups{0};
+    std::atomic<uint32_t> mPreviousWakeups{0};
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Unbounded lock-free queue for many producers and one consumer (D. Vyukov's intrusive MPSC
+// design). A push is one exchange and one store, so producers never wait for each other or
+// for the consumer. The one node the consumer holds on to is the last value it took, so the
+// list is never empty and push and tryPop do not touch the same pointer.
+//
+// A producer that is preempted between its exchange and its store hides what was pushed
+// after it until it runs again; tryPop then returns false although the queue is not empty.
+template <typename T>
+class Mailbox {
+public:
+    Mailbox() = default;
+    ~Mailbox() {
+        T value;
+        while (tryPop(value)) {
+        }
+        if (mTail != &mStub) {
+            delete mTail;
+        }
+    }
+    Mailbox(const Mailbox &) = delete;
+    Mailbox &operator=(const Mailbox &) = delete;
+
+    // From any thread
+    void push(T value) {
+        Node *const node = new Node;
+        node->value = std::move(value);
+        Node *const previous = mHead.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // From one thread at a time; moves the oldest value into value, or returns false
+    bool tryPop(T &value) {
+        Node *const tail = mTail;
+        Node *const next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        // next stays as the node we hold on to, with its value gone
+        mTail = next;
+        if (tail != &mStub) {
+            delete tail;
+        }
+        return true;
+    }
+private:
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        T value;
+    };
+
+    Node mStub;
+    // Kept on separate cache lines, as producers and consumer update them independently
+    alignas(64) std::atomic<Node *> mHead{&mStub};
+    alignas(64) Node *mTail = &mStub;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
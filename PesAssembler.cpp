@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "PesAssembler.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+// packet_start_code_prefix, stream_id and PES_packet_length
+constexpr std::size_t PES_HEADER_SIZE = 6;
+// PES_packet_length zero is only allowed for video; such a packet ends where its piece does
+constexpr std::size_t UNBOUNDED = 0;
+
+// Whether data can be the start of a PES packet, as far as there is data to tell
+bool startsPacket(const char *data, std::size_t size) {
+    constexpr char startCode[] = {0, 0, 1};
+    return std::equal(data, data + std::min(size, sizeof(startCode)), startCode);
+}
+
+// Size of the packet that starts with a complete PES header, or UNBOUNDED
+std::size_t getPacketSize(const char *data) {
+    const std::size_t length = (static_cast<std::size_t>(static_cast<uint8_t>(data[4])) << 8) | static_cast<uint8_t>(data[5]);
+    return length == 0 ? UNBOUNDED : PES_HEADER_SIZE + length;
+}
+
+} // namespace
+
+PesChannel getPesChannel(const uint8_t *pes, std::size_t size) {
+    constexpr std::size_t headerLengthOffset = 8;
+    if (size <= headerLengthOffset || pes[0] != 0 || pes[1] != 0 || pes[2] != 1) {
+        return PesChannel::UNKNOWN;
+    }
+    const std::size_t payloadOffset = headerLengthOffset + 1 + pes[headerLengthOffset];
+    if (size <= payloadOffset) {
+        return PesChannel::UNKNOWN;
+    }
+    const uint8_t dataIdentifier = pes[payloadOffset];
+    if ((dataIdentifier >= 0x10 && dataIdentifier <= 0x1f) || (dataIdentifier >= 0x99 && dataIdentifier <= 0x9b)) {
+        return PesChannel::TELETEXT;
+    }
+    if (dataIdentifier == 0x20) {
+        return PesChannel::DVB_SUBTITLES;
+    }
+    return PesChannel::UNKNOWN;
+}
+
+bool getDvbSubtitlePages(const uint8_t *pes, std::size_t size, std::vector<uint16_t> &pages, std::vector<uint16_t> &completePages) {
+    constexpr uint8_t syncByte = 0x0f;
+    constexpr uint8_t pageCompositionSegment = 0x10;
+    constexpr uint8_t acquisitionPoint = 1;
+    constexpr uint8_t modeChange = 2;
+    constexpr std::size_t segmentHeaderSize = 6;
+    pages.clear();
+    completePages.clear();
+    if (getPesChannel(pes, size) != PesChannel::DVB_SUBTITLES) {
+        return false;
+    }
+    // data_identifier and subtitle_stream_id, then the segments up to the end_of_PES_data_field_marker
+    std::size_t offset = 9 + pes[8] + 2;
+    while (offset + segmentHeaderSize <= size && pes[offset] == syncByte) {
+        const uint8_t segmentType = pes[offset + 1];
+        const uint16_t pageId = (pes[offset + 2] << 8) | pes[offset + 3];
+        const std::size_t segmentLength = (pes[offset + 4] << 8) | pes[offset + 5];
+        const uint8_t *segment = pes + offset + segmentHeaderSize;
+        offset += segmentHeaderSize + segmentLength;
+        if (offset > size) {
+            break;
+        }
+        if (std::find(pages.begin(), pages.end(), pageId) == pages.end()) {
+            pages.push_back(pageId);
+        }
+        if (segmentType == pageCompositionSegment && segmentLength >= 2) {
+            // page_time_out, then page_version_number and page_state
+            const uint8_t pageState = (segment[1] >> 2) & 0x03;
+            if (pageState == acquisitionPoint || pageState == modeChange) {
+                completePages.push_back(pageId);
+            }
+        }
+    }
+    return true;
+}
+
+PesAssembler::PesAssembler(DataBufferPool &pool, std::size_t headerSize) : mPool(pool), mHeaderSize(headerSize) {
+}
+
+void PesAssembler::add(subttxrend::common::DataBufferPtr piece, std::vector<subttxrend::common::DataBufferPtr> &complete) {
+    const char *data = piece->data() + mHeaderSize;
+    const std::size_t size = piece->size() - mHeaderSize;
+    const bool starts = size != 0 && startsPacket(data, size);
+    if (starts) {
+        const bool headerIn = size >= PES_HEADER_SIZE;
+        const std::size_t packetSize = headerIn ? getPacketSize(data) : UNBOUNDED;
+        if (!headerIn || packetSize == UNBOUNDED || packetSize >= size) {
+            Pending &pending = startPacket(data, size);
+            if (headerIn && (packetSize == UNBOUNDED || packetSize == size)) {
+                complete.push_back(std::move(piece));
+                return;
+            }
+            pending.buffer = std::move(piece);
+            if (headerIn) {
+                pending.size = mHeaderSize + packetSize;
+                grow(pending, pending.size);
+            }
+            return;
+        }
+    }
+    // More than one packet, or the rest of one, so copy them out
+    Pending *current = starts ? nullptr : getLatest();
+    std::size_t offset = 0;
+    while (offset != size) {
+        if (!current) {
+            if (!startsPacket(data + offset, size - offset)) {
+                break;
+            }
+            current = &startPacket(data + offset, size - offset);
+            current->buffer = mPool.acquire(mHeaderSize + std::min(size - offset, PES_HEADER_SIZE));
+            current->buffer->resize(mHeaderSize);
+        }
+        Pending &pending = *current;
+        offset += append(pending, data + offset, size - offset);
+        if (pending.size == 0 && pending.buffer->size() == mHeaderSize + PES_HEADER_SIZE) {
+            const std::size_t packetSize = getPacketSize(pending.buffer->data() + mHeaderSize);
+            if (packetSize == UNBOUNDED) {
+                pending.buffer->insert(pending.buffer->end(), data + offset, data + size);
+                offset = size;
+                pending.size = pending.buffer->size();
+            } else {
+                pending.size = mHeaderSize + packetSize;
+                grow(pending, pending.size);
+                offset += append(pending, data + offset, size - offset);
+            }
+        }
+        if (pending.size != 0 && pending.buffer->size() == pending.size) {
+            complete.push_back(std::move(pending.buffer));
+            pending.size = 0;
+            current = nullptr;
+        }
+    }
+    mPool.release(std::move(piece));
+}
+
+void PesAssembler::reset() {
+    for (auto &pending : mPending) {
+        drop(pending);
+    }
+}
+
+uint64_t PesAssembler::getDroppedPackets() const {
+    return mDroppedPackets;
+}
+
+bool PesAssembler::isWholePacket(const char *data, std::size_t size) {
+    return size >= PES_HEADER_SIZE && startsPacket(data, size) && getPacketSize(data) == size;
+}
+
+PesAssembler::Pending &PesAssembler::startPacket(const char *data, std::size_t size) {
+    Pending &pending = mPending[static_cast<std::size_t>(getPesChannel(reinterpret_cast<const uint8_t *>(data), size))];
+    if (pending.buffer) {
+        // The rest of it got lost
+        ++mDroppedPackets;
+        drop(pending);
+    }
+    pending.started = ++mStarted;
+    return pending;
+}
+
+PesAssembler::Pending *PesAssembler::getLatest() {
+    Pending *latest = nullptr;
+    for (auto &pending : mPending) {
+        if (pending.buffer && (!latest || pending.started > latest->started)) {
+            latest = &pending;
+        }
+    }
+    return latest;
+}
+
+void PesAssembler::drop(Pending &pending) {
+    mPool.release(std::move(pending.buffer));
+    pending.size = 0;
+}
+
+std::size_t PesAssembler::append(Pending &pending, const char *data, std::size_t size) {
+    const std::size_t end = pending.size != 0 ? pending.size : mHeaderSize + PES_HEADER_SIZE;
+    const std::size_t count = std::min(size, end - pending.buffer->size());
+    pending.buffer->insert(pending.buffer->end(), data, data + count);
+    return count;
+}
+
+void PesAssembler::grow(Pending &pending, std::size_t capacity) {
+    if (pending.buffer->capacity() >= capacity) {
+        return;
+    }
+    auto buffer = mPool.acquire(capacity);
+    buffer->insert(buffer->end(), pending.buffer->begin(), pending.buffer->end());
+    mPool.release(std::move(pending.buffer));
+    pending.buffer = std::move(buffer);
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
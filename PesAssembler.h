@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <subttxrend/common/DataBuffer.hpp>
+#include <vector>
+
+#include "DataBufferPool.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+enum class PesChannel {
+    UNKNOWN,
+    TELETEXT,
+    DVB_SUBTITLES
+};
+
+// Which decoder a PES packet is for, from the data_identifier that starts its payload
+// (EN 300 472 for teletext, EN 300 743 for DVB subtitles); UNKNOWN if size does not reach it
+PesChannel getPesChannel(const uint8_t *pes, std::size_t size);
+
+// Collects the page ids of the segments of a DVB subtitle PES packet (EN 300 743) into pages, and
+// those whose page composition is an acquisition point or mode change into completePages: their
+// display set carries all the page needs, so it supersedes earlier ones. False if it is not DVB subtitles.
+bool getDvbSubtitlePages(const uint8_t *pes, std::size_t size, std::vector<uint16_t> &pages, std::vector<uint16_t> &completePages);
+
+// Joins PES packets that are sent cut into pieces, going by their PES_packet_length, so that
+// the decoder only ever sees whole packets. Pieces are buffers from RenderSession::createDataBuffer:
+// headerSize bytes of packet header room followed by the data. A piece that is exactly one packet
+// is passed on as it is. A piece that starts a packet becomes the buffer the packet is gathered
+// in, grown once from the pool to the size of the whole packet when that is known.
+//
+// A packet is gathered per channel, so that teletext and DVB subtitles sent side by side don't
+// end up in each other's packets. A piece without a start code continues the packet of the
+// channel that started one last. A start code drops what its channel still had pending, so that
+// a piece that got lost costs one packet only. Data that neither continues nor starts a packet
+// is dropped. Not thread safe.
+class PesAssembler {
+public:
+    PesAssembler(DataBufferPool &pool, std::size_t headerSize);
+    PesAssembler(const PesAssembler &) = delete;
+    PesAssembler &operator=(const PesAssembler &) = delete;
+
+    // Takes a piece and appends the packets it completes to complete
+    void add(subttxrend::common::DataBufferPtr piece, std::vector<subttxrend::common::DataBufferPtr> &complete);
+    // Forgets the packets that are being gathered
+    void reset();
+    // Whether data, without packet header, is exactly one PES packet with a PES_packet_length
+    static bool isWholePacket(const char *data, std::size_t size);
+    // Number of packets dropped as incomplete when their channel started a new one
+    uint64_t getDroppedPackets() const;
+private:
+    struct Pending {
+        // The packet being gathered, behind the header room
+        subttxrend::common::DataBufferPtr buffer;
+        // Size buffer will have when the packet is complete; zero until its PES header is in
+        std::size_t size = 0;
+        // When the packet was started, to find the latest one
+        uint64_t started = 0;
+    };
+    static constexpr std::size_t NUM_CHANNELS = 3;
+
+    // Drops what the channel of the packet starting at data had pending and makes it the latest
+    Pending &startPacket(const char *data, std::size_t size);
+    // The latest packet that was started and is not complete yet, or nullptr
+    Pending *getLatest();
+    void drop(Pending &pending);
+    // Appends up to size bytes to pending, as far as its packet goes; returns how many were taken
+    std::size_t append(Pending &pending, const char *data, std::size_t size);
+    void grow(Pending &pending, std::size_t capacity);
+
+    DataBufferPool &mPool;
+    const std::size_t mHeaderSize;
+    // By PesChannel
+    std::array<Pending, NUM_CHANNELS> mPending;
+    uint64_t mStarted = 0;
+    uint64_t mDroppedPackets = 0;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
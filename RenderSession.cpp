@@ -26,6 +26,10 @@
 #include <tracing/Logging.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+
 #if TEXTTRACK_WITH_CHOWN_DOBBYAPP
 #include <pwd.h>
 #endif
@@ -67,20 +71,31 @@ namespace Plugin {
 // That can pass data on to actual processing
 //   NB: we can get control-packets that way as well as data-packets. The Ctrl might want to perform the same operations as the API functions.
 
-RenderSession::RenderSession(subttxrend::ctrl::Configuration &configuration, std::string displayName, std::string socketName)
+RenderSession::RenderSession(subttxrend::ctrl::Configuration &configuration, const RenderSessionSettings &settings, std::string displayName,
+                             std::string socketName)
     : mLogger("App", "RenderSession", this),
       mConfiguration(configuration),
       mDisplayName(std::move(displayName)),
       mSocketName(std::move(socketName)),
       mLastActiveTime(std::chrono::steady_clock::now()),
-      mFontCache{std::make_shared<subttxrend::gfx::PrerenderedFontCache>()} {
+      mBatchedSocket(settings.batchedSocket),
+      mSharedMemorySize(settings.sharedMemorySize),
+      mFontCache{std::make_shared<subttxrend::gfx::PrerenderedFontCache>()},
+      mRenderThreadSettings(settings.renderThread),
+      mRenderWorkers(settings.renderWorkers),
+      mRenderPolicy{settings.renderFirst, settings.renderCpuBudget},
+      mPipelined(settings.pipelinedRendering),
+      mDataQueueOverflow(settings.dataQueueOverflow),
+      mDataQueue(settings.dataQueueCapacity),
+      mMaxDataLatency(settings.maxDataLatency),
+      mFilterCcData(settings.ccPreFilter) {
     mLogger.osinfo(__LOGGER_FUNC__, " - creating GFX engine for ", mDisplayName);
     mGfxEngine = subttxrend::gfx::Factory::createEngine();
     mGfxEngine->init(mDisplayName);
 }
 
-RenderSession::RenderSession(subttxrend::ctrl::Configuration &configuration, std::string displayName)
-    : RenderSession(configuration, std::move(displayName), std::string()) {
+RenderSession::RenderSession(subttxrend::ctrl::Configuration &configuration, const RenderSessionSettings &settings, std::string displayName)
+    : RenderSession(configuration, settings, std::move(displayName), std::string()) {
 }
 
 RenderSession::~RenderSession() {
@@ -101,53 +116,80 @@ void RenderSession::start() {
     mGfxEngine->attach(mGfxWindow);
 
     if (!mSocketName.empty()) {
-        mLogger.osinfo(__LOGGER_FUNC__, " - creating socket source ", mSocketName);
-        mSocket = subttxrend::socksrc::UnixSocketSourceFactory().create(mSocketName);
-        if (!mSocket) {
+        mStreamBroken = false;
+        if (!openSocket()) {
             mLogger.osfatal(__LOGGER_FUNC__, " - Cannot create socket source");
             throw std::runtime_error("error while creating source");
         }
+        mStopReconnect = false;
+        mReconnectThread = std::thread(&RenderSession::reconnectLoop, this);
+    }
 
-        mLogger.ostrace(__LOGGER_FUNC__, " - Starting source");
-        mSocket->start(this);
+    if (mSharedMemory) {
+        mSharedMemory->start(this);
+    }
 
-#if TEXTTRACK_WITH_CHOWN_DOBBYAPP
-        {
-            struct passwd user;
-            struct passwd *result{nullptr};
-            char extra_info[8192];
-            mLogger.osinfo(__LOGGER_FUNC__, " - Change owner of socket source to dobbyapp");
-            if (getpwnam_r("dobbyapp", &user, extra_info, sizeof(extra_info), &result) == 0 && result != nullptr) {
-                // Our challenge now is that creation of the socket is asynchronous in the socket source thread
-                // and there is no callback to know when it has been created. Our only choice is to try over and
-                // over until we have the socket. This usually happens in ~10ms.
-                // If for some reason the socket thread fails, the socket will never be created, so never wait
-                // for longer than ~200ms before just moving on with whatever owner the socket may have or not have.
-                // Also move on if the error is not ENOENT
-                int ret = 0;
-                for (int i = 0; i != 20; ++i) {
-                    ret = chown(mSocketName.c_str(), user.pw_uid, user.pw_gid);
-                    if (ret == 0 || errno != ENOENT) {
-                        break;
-                    }
-                    usleep(10000);
-                }
-                if (ret != 0) {
-                    mLogger.oserror(__LOGGER_FUNC__, " - chown failed, errno=", errno);
-                }
-            } else {
-                mLogger.oserror(__LOGGER_FUNC__, " - Unable to lookup uid of dobbyapp");
-            }
+    mQuitRenderThread = false;
+    if (mRenderWorkers) {
+        mLogger.ostrace(__LOGGER_FUNC__, " - Adding to render workers");
+        mRenderWorkers->add(*this, mRenderPolicy);
+        if (mPipelined) {
+            // Presenting is part of rendering, so it counts against the budget and fair share of the session
+            mRenderWorkers->add(mPresentTask, *this);
+        }
+    } else {
+        mLogger.ostrace(__LOGGER_FUNC__, " - Starting render thread");
+        mRenderThread = std::thread(&RenderSession::processLoop, this);
+        if (mPipelined) {
+            mPresentThread = std::thread(&RenderSession::presentLoop, this);
         }
-#endif
     }
+}
 
-    mLogger.ostrace(__LOGGER_FUNC__, " - Starting render thread");
+bool RenderSession::openSocket() {
+    mLogger.osinfo(__LOGGER_FUNC__, " - creating socket source ", mSocketName);
+    if (mBatchedSocket) {
+        mSocket = std::make_unique<BatchSocketSource>(mSocketName, mBufferPool, mRenderWorkers);
+    } else {
+        mSocket = subttxrend::socksrc::UnixSocketSourceFactory().create(mSocketName);
+    }
+    if (!mSocket) {
+        return false;
+    }
+
+    mLogger.ostrace(__LOGGER_FUNC__, " - Starting source");
+    mSocket->start(this);
+
+#if TEXTTRACK_WITH_CHOWN_DOBBYAPP
     {
-        LockGuard lock{mRenderMutex};
-        mQuitRenderThread = false;
+        struct passwd user;
+        struct passwd *result{nullptr};
+        char extra_info[8192];
+        mLogger.osinfo(__LOGGER_FUNC__, " - Change owner of socket source to dobbyapp");
+        if (getpwnam_r("dobbyapp", &user, extra_info, sizeof(extra_info), &result) == 0 && result != nullptr) {
+            // Our challenge now is that creation of the socket is asynchronous in the socket source thread
+            // and there is no callback to know when it has been created. Our only choice is to try over and
+            // over until we have the socket. This usually happens in ~10ms.
+            // If for some reason the socket thread fails, the socket will never be created, so never wait
+            // for longer than ~200ms before just moving on with whatever owner the socket may have or not have.
+            // Also move on if the error is not ENOENT
+            int ret = 0;
+            for (int i = 0; i != 20; ++i) {
+                ret = chown(mSocketName.c_str(), user.pw_uid, user.pw_gid);
+                if (ret == 0 || errno != ENOENT) {
+                    break;
+                }
+                usleep(10000);
+            }
+            if (ret != 0) {
+                mLogger.oserror(__LOGGER_FUNC__, " - chown failed, errno=", errno);
+            }
+        } else {
+            mLogger.oserror(__LOGGER_FUNC__, " - Unable to lookup uid of dobbyapp");
+        }
     }
-    mRenderThread = std::thread(&RenderSession::processLoop, this);
+#endif
+    return true;
 }
 
 void RenderSession::close() {
@@ -162,34 +204,57 @@ void RenderSession::stop() {
         return;
     }
     mStarted = false;
+    if (mReconnectThread.joinable()) {
+        {
+            LockGuard lock{mReconnectMutex};
+            mStopReconnect = true;
+        }
+        mReconnectCond.notify_one();
+        mReconnectThread.join();
+    }
     if (!mSocketName.empty() && mSocket) {
         mSocket->stop();
         mSocket.reset();
         unlink(mSocketName.c_str());
     }
+    if (mSharedMemory) {
+        mSharedMemory->stop();
+        mSharedMemory.reset();
+    }
 #if TEXTTRACK_WITH_CCHAL
     dissociateVideoDecoder();
 #endif
-    {
-        LockGuard lock{mRenderMutex};
-        mQuitRenderThread = true;
-    }
-    mRenderCond.notify_one();
-    mLogger.osinfo(__LOGGER_FUNC__, " joins render thread");
-    if (mRenderThread.joinable()) {
-        mRenderThread.join();
-    }
-    {
-        LockGuard lock{mDataMutex};
-        mDataQueue.clear();
+    mQuitRenderThread = true;
+    if (mRenderWorkers) {
+        mLogger.osinfo(__LOGGER_FUNC__, " leaves render workers");
+        // The present task is charged to the session, so it leaves first
+        mRenderWorkers->remove(mPresentTask);
+        mRenderWorkers->remove(*this);
+    } else {
+        wakeRenderThread(Doorbell::Priority::URGENT);
+        mLogger.osinfo(__LOGGER_FUNC__, " joins render thread");
+        if (mRenderThread.joinable()) {
+            mRenderThread.join();
+        }
+        mPresentDoorbell.ring(Doorbell::Priority::URGENT);
+        if (mPresentThread.joinable()) {
+            mPresentThread.join();
+        }
     }
+    mFramePending = false;
+    // Apply what the render thread did not get to, so nobody waits for a command forever
+    processControlCommands();
+    clearDataQueue();
+    mBufferPool.trim();
     mLogger.osinfo(__LOGGER_FUNC__, " resets decoder");
     {
         LockGuard lock{mDecoderMutex};
+        mSidecarFile.reset();
         if (mDecoder) {
             mDecoder->deactivate();
             mDecoder.reset();
         }
+        publishRenderingActive();
     }
     mLogger.osinfo(__LOGGER_FUNC__, " detaches GFX window");
     if (mGfxWindow) {
@@ -206,6 +271,34 @@ std::string RenderSession::getSocketName() const {
     return mSocketName;
 }
 
+RenderSessionStatistics RenderSession::getStatistics() const {
+    RenderSessionStatistics statistics;
+    statistics.droppedPackets = mDroppedBuffers.load();
+    statistics.expiredPackets = mExpiredPackets.load();
+    statistics.wakeupsPerSecond = mRenderDoorbell.getWakeupsPerSecond();
+    statistics.socketReconnects = mSocketReconnects.load();
+    statistics.ccFilterInputBytes = mCcFilterInputBytes.load();
+    statistics.ccFilterOutputBytes = mCcFilterOutputBytes.load();
+    statistics.otherChannelPackets = mOtherChannelPackets.load();
+    {
+        LockGuard lock{mPesMutex};
+        statistics.incompletePesPackets = mPesAssembler.getDroppedPackets();
+    }
+    statistics.coalescedFrames = mCoalescedFrames.load();
+    if (mRenderWorkers) {
+        const auto taskStatistics = mRenderWorkers->getTaskStatistics(*this);
+        const auto presentStatistics = mRenderWorkers->getTaskStatistics(mPresentTask);
+        statistics.averageTimerErrorUs = static_cast<uint32_t>(taskStatistics.averageTimerError.count());
+        statistics.maxTimerErrorUs = static_cast<uint32_t>(taskStatistics.maxTimerError.count());
+        statistics.renderCpuTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(taskStatistics.cpuTime + presentStatistics.cpuTime).count();
+        statistics.overBudgetSeconds = taskStatistics.overBudgetPeriods;
+        statistics.renderThreadSettingsApplied = mRenderWorkers->areThreadSettingsApplied();
+    } else {
+        statistics.renderThreadSettingsApplied = mRenderThreadSettingsApplied.load();
+    }
+    return statistics;
+}
+
 RenderSession::SessionType RenderSession::getSessionType() const {
     return mSessionType;
 }
@@ -222,11 +315,18 @@ namespace {
 struct BuildPacket {
     static std::atomic<uint32_t> sCounter;
     subttxrend::common::DataBufferPtr pBuffer;
-    BuildPacket(subttxrend::protocol::Packet::Type type) : pBuffer(new subttxrend::common::DataBuffer) {
-        this->operator()(static_cast<uint32_t>(type))(++sCounter)(0)(1);
+    std::size_t mPos = 0;
+    // Writes the header into the headroom at the front of buffer, the payload behind it is left in place
+    BuildPacket(subttxrend::protocol::Packet::Type type, subttxrend::common::DataBufferPtr buffer) : pBuffer(std::move(buffer)) {
+        this->operator()(static_cast<uint32_t>(type))(++sCounter)(0)(SESSION_CHANNEL_ID);
     }
     BuildPacket &operator()(uint32_t v) {
-        pBuffer->insert(pBuffer->end(), reinterpret_cast<char *>(&v), reinterpret_cast<char *>(&v) + sizeof(v));
+        if (mPos + sizeof(v) <= pBuffer->size()) {
+            std::memcpy(pBuffer->data() + mPos, &v, sizeof(v));
+        } else {
+            pBuffer->insert(pBuffer->end(), reinterpret_cast<char *>(&v), reinterpret_cast<char *>(&v) + sizeof(v));
+        }
+        mPos += sizeof(v);
         return *this;
     }
     BuildPacket &type(subttxrend::protocol::Packet::Type type) {
@@ -246,17 +346,319 @@ struct BuildPacket {
     }
 };
 std::atomic<uint32_t> BuildPacket::sCounter{0};
+
+// A control packet with a fixed number of 32-bit fields, laid out on the stack the same way as BuildPacket would do it.
+// Only needed where a decoder wants a protocol::Packet; plain commands are dispatched to their handler directly.
+template <std::size_t FIELDS>
+struct ControlPacket {
+    // type, counter, size, channel id
+    static constexpr std::size_t HEADER_WORDS = 4;
+    static constexpr std::size_t SIZE = (HEADER_WORDS + FIELDS) * sizeof(uint32_t);
+    std::array<uint32_t, HEADER_WORDS + FIELDS> words;
+
+    template <typename... Fields>
+    explicit ControlPacket(subttxrend::protocol::Packet::Type type, Fields... fields)
+        : words{static_cast<uint32_t>(type), ++BuildPacket::sCounter, FIELDS * sizeof(uint32_t), SESSION_CHANNEL_ID, static_cast<uint32_t>(fields)...} {
+        static_assert(sizeof...(Fields) == FIELDS, "field count does not match the packet layout");
+    }
+    subttxrend::common::DataBufferPtr toBuffer(DataBufferPool &pool) const {
+        auto buffer = pool.acquire(SIZE);
+        buffer->resize(SIZE);
+        std::memcpy(buffer->data(), words.data(), SIZE);
+        return buffer;
+    }
+};
+template <typename... Fields>
+ControlPacket(subttxrend::protocol::Packet::Type, Fields...) -> ControlPacket<sizeof...(Fields)>;
+
+// The 32 low bits of the 90 kHz PTS of a PES packet, the same part of it the STC is kept in
+bool readPesPts(const uint8_t *pes, std::size_t size, uint32_t &pts) {
+    constexpr std::size_t ptsOffset = 9;
+    if (size < ptsOffset + 5 || pes[0] != 0 || pes[1] != 0 || pes[2] != 1 || (pes[6] & 0xc0) != 0x80 || (pes[7] & 0x80) == 0) {
+        return false;
+    }
+    const uint8_t *p = pes + ptsOffset;
+    pts = (static_cast<uint32_t>(p[0] & 0x06) << 29) | (static_cast<uint32_t>(p[1]) << 22) | (static_cast<uint32_t>(p[2] & 0xfe) << 14) |
+          (static_cast<uint32_t>(p[3]) << 7) | (p[4] >> 1);
+    return true;
+}
+
+// Invalidates the CEA-608 characters in cc_data() triplets, but keeps their control codes, so
+// that caption modes, erase and end-of-caption still apply. CEA-708 service blocks interleave
+// text and commands and are kept whole. Returns whether anything was invalidated.
+bool dropCcText(uint8_t *ccData, std::size_t size) {
+    constexpr uint8_t ccValid = 0x04;
+    bool dropped = false;
+    for (std::size_t i = 0; i + 3 <= size; i += 3) {
+        if ((ccData[i] & ccValid) == 0 || (ccData[i] & 0x03) > 1) {
+            continue;
+        }
+        // Without parity
+        const uint8_t first = ccData[i + 1] & 0x7f;
+        const uint8_t second = ccData[i + 2] & 0x7f;
+        const bool specialCharacter = (first & 0x77) == 0x11 && (second & 0x70) == 0x30;
+        const bool extendedCharacter = (first & 0x76) == 0x12 && (second & 0x60) == 0x20;
+        if (first >= 0x20 || specialCharacter || extendedCharacter) {
+            ccData[i] &= ~ccValid;
+            dropped = true;
+        }
+    }
+    return dropped;
+}
+
+// Of several pieces of data, the whole is refused for why the first piece was
+SendResult firstFailure(SendResult result, SendResult next) {
+    return result == SendResult::ACCEPTED ? next : result;
+}
 } // namespace
 
-bool RenderSession::sendData(DataType type, const std::string &data, int64_t offsetMs) {
-    mLogger.ostrace(__LOGGER_FUNC__, " data is ", data.size(), " bytes, type ", static_cast<unsigned>(type));
+std::size_t RenderSession::getDataHeaderSize(DataType type) {
+    // Type, counter, size and channel id, followed by the type specific fields
+    constexpr std::size_t commonSize = 4 * sizeof(uint32_t);
+    switch (type) {
+        case DataType::PES:
+            return commonSize + sizeof(uint32_t); // channel type
+        case DataType::TTML:
+        case DataType::WEBVTT:
+            return commonSize + sizeof(int64_t); // display offset
+        case DataType::CC:
+            return commonSize + 3 * sizeof(uint32_t); // channel type, pts present, pts
+    }
+    return 0;
+}
+
+subttxrend::common::DataBufferPtr RenderSession::createDataBuffer(DataType type, std::size_t payloadSize) {
+    const std::size_t headerSize = getDataHeaderSize(type);
+    auto buffer = mBufferPool.acquire(headerSize + payloadSize);
+    buffer->resize(headerSize);
+    return buffer;
+}
+
+bool RenderSession::openSharedMemory(const std::string &name) {
+    if (mSharedMemory) {
+        return mSharedMemory->getName() == name;
+    }
+    auto source = std::make_unique<SharedMemorySource>(name, mSharedMemorySize, mBufferPool);
+    if (!source->open()) {
+        return false;
+    }
+    mSharedMemory = std::move(source);
+    if (mStarted) {
+        mSharedMemory->start(this);
+    }
+    return true;
+}
+
+std::string RenderSession::getSharedMemoryName() const {
+    return mSharedMemory ? mSharedMemory->getName() : std::string();
+}
+
+void RenderSession::setSidecarFile(std::shared_ptr<SidecarFile> file, int64_t offsetMs) {
+    onCommand([this, file = std::move(file), offsetMs]() {
+        mSidecarFile = file;
+        mSidecarOffsetMs = offsetMs;
+        mSidecarTimeMs.reset();
+    });
+}
+
+void RenderSession::processSidecarTimestamp(uint64_t mediaTimestampMs) {
+    // How far ahead of the media time cues are handed to the decoder
+    constexpr uint64_t lookaheadMs = 10000;
+    if (!mSidecarFile) {
+        return;
+    }
+    // A positive offset shows the subtitles later, so they are due at an earlier document time
+    const int64_t documentTimeMs = static_cast<int64_t>(mediaTimestampMs) - mSidecarOffsetMs;
+    const uint64_t timeMs = documentTimeMs > 0 ? static_cast<uint64_t>(documentTimeMs) : 0;
+    // Start over from the current position after a seek, otherwise just continue
+    if (!mSidecarTimeMs || timeMs < *mSidecarTimeMs || timeMs > *mSidecarTimeMs + lookaheadMs) {
+        if (mSidecarFile->seek(timeMs)) {
+            // The decoder still holds the cues we are about to hand out again
+            restartSidecarDecoder();
+        }
+    }
+    mSidecarTimeMs = timeMs;
+    const DataType type = mSidecarFile->getFormat() == SidecarFile::Format::TTML ? DataType::TTML : DataType::WEBVTT;
+    auto buffer = createDataBuffer(type, 0);
+    if (mSidecarFile->takeCues(timeMs + lookaheadMs, *buffer)) {
+        if (auto packet = buildDataPacket(type, std::move(buffer), mSidecarOffsetMs)) {
+            processPacket(mParser.parse(std::move(packet)));
+        }
+    } else {
+        mBufferPool.release(std::move(buffer));
+    }
+}
+
+void RenderSession::restartSidecarDecoder() {
+    if (!mDecoder) {
+        return;
+    }
+    // Selecting the service again replaces the decoder with an empty one, keeping mute and styling
+    switch (mSessionType) {
+        case SessionType::WEBVTT: {
+            const ControlPacket packet(subttxrend::protocol::Packet::Type::WEBVTT_SELECTION, mVideoWidth, mVideoHeight);
+            processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+            break;
+        }
+        case SessionType::TTML: {
+            const ControlPacket packet(subttxrend::protocol::Packet::Type::TTML_SELECTION, mVideoWidth, mVideoHeight);
+            processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+            break;
+        }
+        default:;
+    }
+}
+
+void RenderSession::resetPesAssembler() {
+    LockGuard lock{mPesMutex};
+    mPesAssembler.reset();
+}
+
+bool RenderSession::wantsPesData(const char *pes, std::size_t size) const {
+    // Anything but a whole packet may continue or hold packets of other channels; those are
+    // sorted out once mPesAssembler has put them together
+    return !PesAssembler::isWholePacket(pes, size) || wantsPesChannel(pes, size);
+}
+
+bool RenderSession::wantsPesChannel(const char *pes, std::size_t size) const {
+    switch (getPesChannel(reinterpret_cast<const uint8_t *>(pes), size)) {
+        case PesChannel::TELETEXT:
+            return mSessionType == SessionType::TTX;
+        case PesChannel::DVB_SUBTITLES:
+            return mSessionType == SessionType::DVB;
+        case PesChannel::UNKNOWN:
+            break;
+    }
+    // Leave it to the decoder
+    return true;
+}
+
+bool RenderSession::isForOtherChannel(const subttxrend::common::DataBuffer &pesBuffer) const {
+    const std::size_t headerSize = getDataHeaderSize(DataType::PES);
+    return pesBuffer.size() > headerSize && !wantsPesChannel(pesBuffer.data() + headerSize, pesBuffer.size() - headerSize);
+}
+
+SendResult RenderSession::queuePesData(subttxrend::common::DataBufferPtr buffer, bool active, bool &queuedAny) {
+    if (!buffer || buffer->size() < getDataHeaderSize(DataType::PES)) {
+        // Let buildDataPacket complain
+        return buildDataPacket(DataType::PES, std::move(buffer), 0) ? SendResult::ACCEPTED : SendResult::BAD_DATA;
+    }
+    std::vector<subttxrend::common::DataBufferPtr> packets;
+    {
+        LockGuard lock{mPesMutex};
+        mPesAssembler.add(std::move(buffer), packets);
+    }
+    SendResult result = SendResult::ACCEPTED;
+    for (auto &packet : packets) {
+        if (isForOtherChannel(*packet)) {
+            ++mOtherChannelPackets;
+            mBufferPool.release(std::move(packet));
+            continue;
+        }
+        auto dataPacket = buildDataPacket(DataType::PES, std::move(packet), 0);
+        if (!dataPacket) {
+            result = firstFailure(result, SendResult::BAD_DATA);
+        } else if (!active) {
+            mBufferPool.release(std::move(dataPacket));
+        } else if (enqueueBuffer(std::move(dataPacket), Compression::NONE)) {
+            queuedAny = true;
+        } else {
+            result = firstFailure(result, SendResult::QUEUE_FULL);
+        }
+    }
+    return result;
+}
+
+SendResult RenderSession::sendData(DataType type, subttxrend::common::DataBufferPtr buffer, int64_t offsetMs, Compression compression) {
+    if (type == DataType::PES) {
+        bool queuedAny = false;
+        const SendResult result = queuePesData(std::move(buffer), acceptsData(), queuedAny);
+        if (queuedAny) {
+            wakeRenderThread();
+        }
+        return result;
+    }
+    if (type == DataType::CC && mFilterCcData && buffer && !filterCcPayload(*buffer)) {
+        // Nothing the decoder would act on
+        mBufferPool.release(std::move(buffer));
+        return SendResult::ACCEPTED;
+    }
+    auto packet = buildDataPacket(type, std::move(buffer), offsetMs);
+    if (!packet) {
+        return SendResult::BAD_DATA;
+    }
+    if (acceptsData()) {
+        if (!enqueueBuffer(std::move(packet), compression)) {
+            return SendResult::QUEUE_FULL;
+        }
+        wakeRenderThread();
+    }
+    return SendResult::ACCEPTED;
+}
+
+SendResult RenderSession::sendDataBatch(std::vector<DataEntry> entries) {
+    SendResult result = SendResult::ACCEPTED;
+    const bool active = acceptsData();
+    for (auto &entry : entries) {
+        if (entry.type == DataType::PES) {
+            bool queuedAny = false;
+            result = firstFailure(result, queuePesData(std::move(entry.buffer), active, queuedAny));
+            continue;
+        }
+        if (entry.type == DataType::CC && mFilterCcData && entry.buffer && !filterCcPayload(*entry.buffer)) {
+            mBufferPool.release(std::move(entry.buffer));
+            continue;
+        }
+        auto packet = buildDataPacket(entry.type, std::move(entry.buffer), entry.offsetMs);
+        if (!packet) {
+            result = firstFailure(result, SendResult::BAD_DATA);
+        } else if (active && !enqueueBuffer(std::move(packet), entry.compression)) {
+            result = firstFailure(result, SendResult::QUEUE_FULL);
+        }
+    }
+    if (active && !entries.empty()) {
+        wakeRenderThread();
+    }
+    return result;
+}
+
+std::size_t RenderSession::runCcPreFilter(const uint8_t *ccData, std::size_t size) {
+    mCcFilterOutput.resize(size + CcPreFilter::MAX_GROWTH);
+    const std::size_t filtered = mCcPreFilter.filter(ccData, size, reinterpret_cast<uint8_t *>(mCcFilterOutput.data()));
+    mCcFilterInputBytes += size;
+    mCcFilterOutputBytes += filtered;
+    return filtered;
+}
+
+bool RenderSession::filterCcPayload(subttxrend::common::DataBuffer &buffer) {
+    const std::size_t headerSize = getDataHeaderSize(DataType::CC);
+    if (buffer.size() < headerSize) {
+        // Let buildDataPacket complain
+        return true;
+    }
+    LockGuard lock{mCcFilterMutex};
+    const std::size_t filtered = runCcPreFilter(reinterpret_cast<const uint8_t *>(buffer.data()) + headerSize, buffer.size() - headerSize);
+    buffer.resize(headerSize);
+    buffer.insert(buffer.end(), mCcFilterOutput.begin(), mCcFilterOutput.begin() + filtered);
+    return filtered != 0;
+}
+
+subttxrend::common::DataBufferPtr RenderSession::buildDataPacket(DataType type, subttxrend::common::DataBufferPtr buffer, int64_t offsetMs) {
     using namespace subttxrend::common;
     using namespace subttxrend::protocol;
-    BuildPacket bp(Packet::Type::INVALID);
+    if (!buffer || buffer->size() < getDataHeaderSize(type)) {
+        mLogger.oserror(__LOGGER_FUNC__, " buffer has no room for the packet header");
+        mBufferPool.release(std::move(buffer));
+        return nullptr;
+    }
+    mLogger.ostrace(__LOGGER_FUNC__, " data is ", buffer->size() - getDataHeaderSize(type), " bytes, type ", static_cast<unsigned>(type));
+    BuildPacket bp(Packet::Type::INVALID, std::move(buffer));
     switch (type) {
         case DataType::PES: {
             bp.type(Packet::Type::PES_DATA);
-            bp(0); // TODO channeltype
+            // Channel type. subttxrend-protocol defines no values for it and its decoders ignore it;
+            // teletext and DVB subtitles of one stream are told apart by queuePesData instead.
+            bp(0);
             break;
         }
         case DataType::TTML: {
@@ -279,62 +681,71 @@ bool RenderSession::sendData(DataType type, const std::string &data, int64_t off
         }
         default:
             mLogger.osinfo(__LOGGER_FUNC__, " bad type");
-            return false;
+            mBufferPool.release(std::move(bp.pBuffer));
+            return nullptr;
     }
-    std::copy(data.begin(), data.end(), std::back_inserter(*bp.pBuffer));
-    addBuffer(bp);
-    return true;
+    return bp;
 }
 
 // Generally, all packets are sent as Packet (except Data, which is buffer)
+// API calls are turned into commands on the control lane, which the render thread applies before any queued data
 
 void RenderSession::sendTimestamp(uint64_t iMediaTimestampMs) {
-    switch (mSessionType) {
-        case SessionType::WEBVTT: {
-            BuildPacket bp(subttxrend::protocol::Packet::Type::WEBVTT_TIMESTAMP);
-            bp(iMediaTimestampMs & 0xffffffff)(iMediaTimestampMs >> 32);
-            onPacketReceived(mParser.parse(bp));
-            break;
-        }
-        case SessionType::TTML: {
-            BuildPacket bp(subttxrend::protocol::Packet::Type::TTML_TIMESTAMP);
-            bp(iMediaTimestampMs & 0xffffffff)(iMediaTimestampMs >> 32);
-            onPacketReceived(mParser.parse(bp));
-            break;
+    onCommand([this, iMediaTimestampMs]() {
+        processSidecarTimestamp(iMediaTimestampMs);
+        switch (mSessionType) {
+            case SessionType::WEBVTT: {
+                const ControlPacket packet(subttxrend::protocol::Packet::Type::WEBVTT_TIMESTAMP, iMediaTimestampMs & 0xffffffff, iMediaTimestampMs >> 32);
+                processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+                break;
+            }
+            case SessionType::TTML: {
+                const ControlPacket packet(subttxrend::protocol::Packet::Type::TTML_TIMESTAMP, iMediaTimestampMs & 0xffffffff, iMediaTimestampMs >> 32);
+                processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+                break;
+            }
+            default:; // Unhandled
         }
-        default:; // Unhandled
-    }
+    });
 }
 
+// Commands without parameters skip the packet and go straight to their handler
+
 void RenderSession::pause() {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::PAUSE);
-    onPacketReceived(mParser.parse(bp));
+    onCommand([this]() { processPause(); });
 }
 
 void RenderSession::resume() {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::RESUME);
-    onPacketReceived(mParser.parse(bp));
+    onCommand([this]() { processResume(); });
 }
 
 void RenderSession::reset() {
     close();
-    BuildPacket bp(subttxrend::protocol::Packet::Type::RESET_CHANNEL);
-    onPacketReceived(mParser.parse(bp));
+    resetPesAssembler();
+    onCommand([this]() {
+        mSidecarFile.reset();
+        processResetChannel(mDecoderChannelId == SESSION_CHANNEL_ID);
+    });
 }
 
 void RenderSession::mute() {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::MUTE);
-    onPacketReceived(mParser.parse(bp));
+    onCommand([this]() { processMute(); });
 }
 
 void RenderSession::unmute() {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::UNMUTE);
-    onPacketReceived(mParser.parse(bp));
+    onCommand([this]() { processUnmute(); });
 }
 
 void RenderSession::applyCcStyling(const SubttxClosedCaptionsStyle &styling) {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::SET_CC_ATTRIBUTES);
-    bp(1); // CC type, appears to be unused
+    onCommand([this, styling]() {
+        if (!mCustomCcStyling.has_value()) {
+            processCcStyling(styling);
+            processPreviewRefresh();
+        }
+    });
+}
+
+void RenderSession::processCcStyling(const SubttxClosedCaptionsStyle &styling) {
     // Attribute mask for which attributes are set. We always set (almost) all of them.
     static const uint32_t attributeMask = static_cast<uint32_t>(subttxrend::protocol::PacketSetCCAttributes::CcAttribType::FONT_COLOR) |
                                           static_cast<uint32_t>(subttxrend::protocol::PacketSetCCAttributes::CcAttribType::BACKGROUND_COLOR) |
@@ -348,27 +759,28 @@ void RenderSession::applyCcStyling(const SubttxClosedCaptionsStyle &styling) {
                                           static_cast<uint32_t>(subttxrend::protocol::PacketSetCCAttributes::CcAttribType::WIN_OPACITY) |
                                           static_cast<uint32_t>(subttxrend::protocol::PacketSetCCAttributes::CcAttribType::EDGE_TYPE) |
                                           static_cast<uint32_t>(subttxrend::protocol::PacketSetCCAttributes::CcAttribType::EDGE_COLOR);
-    bp(attributeMask);
-    bp(styling.fontColor);         // PacketSetCCAttributes::CcAttribType::FONT_COLOR,
-    bp(styling.backgroundColor);   // PacketSetCCAttributes::CcAttribType::BACKGROUND_COLOR,
-    bp(styling.fontOpacity);       // PacketSetCCAttributes::CcAttribType::FONT_OPACITY,
-    bp(styling.backgroundOpacity); // PacketSetCCAttributes::CcAttribType::BACKGROUND_OPACITY,
-    bp(styling.fontStyle);         // PacketSetCCAttributes::CcAttribType::FONT_STYLE,
-    bp(styling.fontSize);          // PacketSetCCAttributes::CcAttribType::FONT_SIZE,
-    bp(-1);                        // PacketSetCCAttributes::CcAttribType::FONT_ITALIC,
-    bp(-1);                        // PacketSetCCAttributes::CcAttribType::FONT_UNDERLINE,
-    bp(-1);                        // PacketSetCCAttributes::CcAttribType::BORDER_TYPE,
-    bp(0xff000000);                // PacketSetCCAttributes::CcAttribType::BORDER_COLOR,
-    bp(styling.windowColor);       // PacketSetCCAttributes::CcAttribType::WIN_COLOR,
-    bp(styling.windowOpacity);     // PacketSetCCAttributes::CcAttribType::WIN_OPACITY,
-    bp(styling.edgeType);          // PacketSetCCAttributes::CcAttribType::EDGE_TYPE,
-    bp(styling.edgeColor);         // PacketSetCCAttributes::CcAttribType::EDGE_COLOR
-    onPacketReceived(mParser.parse(bp));
-}
-
-void RenderSession::refreshClosedCaptionPreview() {
+    const ControlPacket packet(subttxrend::protocol::Packet::Type::SET_CC_ATTRIBUTES,
+                               1, // CC type, appears to be unused
+                               attributeMask,
+                               styling.fontColor,         // PacketSetCCAttributes::CcAttribType::FONT_COLOR,
+                               styling.backgroundColor,   // PacketSetCCAttributes::CcAttribType::BACKGROUND_COLOR,
+                               styling.fontOpacity,       // PacketSetCCAttributes::CcAttribType::FONT_OPACITY,
+                               styling.backgroundOpacity, // PacketSetCCAttributes::CcAttribType::BACKGROUND_OPACITY,
+                               styling.fontStyle,         // PacketSetCCAttributes::CcAttribType::FONT_STYLE,
+                               styling.fontSize,          // PacketSetCCAttributes::CcAttribType::FONT_SIZE,
+                               -1,                        // PacketSetCCAttributes::CcAttribType::FONT_ITALIC,
+                               -1,                        // PacketSetCCAttributes::CcAttribType::FONT_UNDERLINE,
+                               -1,                        // PacketSetCCAttributes::CcAttribType::BORDER_TYPE,
+                               0xff000000,                // PacketSetCCAttributes::CcAttribType::BORDER_COLOR,
+                               styling.windowColor,       // PacketSetCCAttributes::CcAttribType::WIN_COLOR,
+                               styling.windowOpacity,     // PacketSetCCAttributes::CcAttribType::WIN_OPACITY,
+                               styling.edgeType,          // PacketSetCCAttributes::CcAttribType::EDGE_TYPE,
+                               styling.edgeColor);        // PacketSetCCAttributes::CcAttribType::EDGE_COLOR
+    processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+}
+
+void RenderSession::processPreviewRefresh() {
     // If we have a preview text, refresh it to make the style take effect
-    LockGuard lock{mDecoderMutex};
     if (!mPreviewText.empty()) {
         if (mDecoder && mSessionType == SessionType::CC) {
             if (auto *const ccDecoder = static_cast<subttxrend::ctrl::CcSubController *>(mDecoder.get())) {
@@ -378,37 +790,53 @@ void RenderSession::refreshClosedCaptionPreview() {
     }
 }
 
+// The session type is set right away, so that callers can rely on it before the render thread has selected the decoder
+
 void RenderSession::selectCcService(CcServiceType type, uint32_t serviceId) {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::SUBTITLE_SELECTION);
-    bp(subttxrend::protocol::PacketSubtitleSelection::SUBTITLES_TYPE_CC)(static_cast<uint32_t>(type))(serviceId);
-    onPacketReceived(mParser.parse(bp));
+    mSessionType = SessionType::CC;
+    onCommand([this, type, serviceId]() {
+        const ControlPacket packet(subttxrend::protocol::Packet::Type::SUBTITLE_SELECTION, subttxrend::protocol::PacketSubtitleSelection::SUBTITLES_TYPE_CC,
+                                   static_cast<uint32_t>(type), serviceId);
+        processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+    });
 }
 
 void RenderSession::selectTtxService(uint16_t page) {
     const uint32_t ttxMagazine = page >= 800 ? 0 : page / 100;
     const uint32_t ttxPage = page % 100;
-    BuildPacket bp(subttxrend::protocol::Packet::Type::SUBTITLE_SELECTION);
-    bp(subttxrend::protocol::PacketSubtitleSelection::SUBTITLES_TYPE_TELETEXT)(ttxMagazine)(ttxPage);
-    onPacketReceived(mParser.parse(bp));
+    mSessionType = SessionType::TTX;
+    resetPesAssembler();
+    onCommand([this, ttxMagazine, ttxPage]() {
+        const ControlPacket packet(subttxrend::protocol::Packet::Type::SUBTITLE_SELECTION,
+                                   subttxrend::protocol::PacketSubtitleSelection::SUBTITLES_TYPE_TELETEXT, ttxMagazine, ttxPage);
+        processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+    });
 }
 
 void RenderSession::selectDvbService(uint16_t compositionPageId, uint16_t ancillaryPageId) {
     mLogger.osinfo(__LOGGER_FUNC__, " unimplemented");
-    // BuildPacket bp(subttxrend::protocol::Packet::Type::WEBVTT_SELECTION);
-    // bp(iVideoWidth)(iVideoHeight);
-    // onPacketReceived(mParser.parse(bp));
+    // const ControlPacket packet(subttxrend::protocol::Packet::Type::WEBVTT_SELECTION, iVideoWidth, iVideoHeight);
+    // processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
 }
 
 void RenderSession::selectWebvttService(uint32_t iVideoWidth, uint32_t iVideoHeight) {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::WEBVTT_SELECTION);
-    bp(iVideoWidth)(iVideoHeight);
-    onPacketReceived(mParser.parse(bp));
+    mSessionType = SessionType::WEBVTT;
+    onCommand([this, iVideoWidth, iVideoHeight]() {
+        mVideoWidth = iVideoWidth;
+        mVideoHeight = iVideoHeight;
+        const ControlPacket packet(subttxrend::protocol::Packet::Type::WEBVTT_SELECTION, iVideoWidth, iVideoHeight);
+        processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+    });
 }
 
 void RenderSession::selectTtmlService(uint32_t iVideoWidth, uint32_t iVideoHeight) {
-    BuildPacket bp(subttxrend::protocol::Packet::Type::TTML_SELECTION);
-    bp(iVideoWidth)(iVideoHeight);
-    onPacketReceived(mParser.parse(bp));
+    mSessionType = SessionType::TTML;
+    onCommand([this, iVideoWidth, iVideoHeight]() {
+        mVideoWidth = iVideoWidth;
+        mVideoHeight = iVideoHeight;
+        const ControlPacket packet(subttxrend::protocol::Packet::Type::TTML_SELECTION, iVideoWidth, iVideoHeight);
+        processPacket(mParser.parse(packet.toBuffer(mBufferPool)));
+    });
 }
 
 void RenderSession::selectScteService() {
@@ -416,41 +844,48 @@ void RenderSession::selectScteService() {
 }
 
 void RenderSession::setTextForClosedCaptionPreview(const std::string &text) {
-    UniqueLock lock{mDecoderMutex};
-    mLogger.osinfo(__LOGGER_FUNC__, " mDecoder=", mDecoder.get(), " mSessionType=", static_cast<int>(mSessionType));
-    mPreviewText = text;
-    if (mDecoder && mSessionType == SessionType::CC) {
-        if (auto *const ccDecoder = static_cast<subttxrend::ctrl::CcSubController *>(mDecoder.get())) {
-            ccDecoder->setTextForPreview(text);
+    onCommand([this, text]() {
+        mLogger.osinfo(__LOGGER_FUNC__, " mDecoder=", mDecoder.get(), " mSessionType=", static_cast<int>(mSessionType.load()));
+        mPreviewText = text;
+        if (mDecoder && mSessionType == SessionType::CC) {
+            if (auto *const ccDecoder = static_cast<subttxrend::ctrl::CcSubController *>(mDecoder.get())) {
+                ccDecoder->setTextForPreview(text);
+            }
         }
-    }
+    });
 }
 
 void RenderSession::setCustomCcStyling(const SubttxClosedCaptionsStyle &styling) {
-    applyCcStyling(styling);
-    refreshClosedCaptionPreview();
-    mCustomCcStyling = styling;
-}
-
-bool RenderSession::hasCustomCcStyling() const {
-    return mCustomCcStyling.has_value();
+    onCommand([this, styling]() {
+        processCcStyling(styling);
+        processPreviewRefresh();
+        mCustomCcStyling = styling;
+    });
 }
 
 bool RenderSession::setCustomTtmlStyling(const std::string &styling) {
-    if (applyTtmlStyling(styling)) {
-        mCustomTtmlStyling = styling;
-        return true;
+    // The session type is set as soon as TTML is selected, so this is known without waiting for the render thread
+    if (mSessionType != SessionType::TTML) {
+        return false;
     }
-    return false;
+    onCommand([this, styling]() {
+        // Kept even if the decoder is not there yet, the selection applies it
+        mCustomTtmlStyling = styling;
+        processTtmlStyling(styling);
+    });
+    return true;
 }
 
-bool RenderSession::hasCustomTtmlStyling() const {
-    return !mCustomTtmlStyling.empty();
+void RenderSession::applyTtmlStyling(const std::string &styling) {
+    onCommand([this, styling]() {
+        if (mCustomTtmlStyling.empty()) {
+            processTtmlStyling(styling);
+        }
+    });
 }
 
-bool RenderSession::applyTtmlStyling(const std::string &styling) {
-    UniqueLock lock{mDecoderMutex};
-    mLogger.osinfo(__LOGGER_FUNC__, " styling=", styling, " mSessionType=", static_cast<int>(mSessionType));
+bool RenderSession::processTtmlStyling(const std::string &styling) {
+    mLogger.osinfo(__LOGGER_FUNC__, " styling=", styling, " mSessionType=", static_cast<int>(mSessionType.load()));
     if (mDecoder && mSessionType == SessionType::TTML) {
         auto *const ttmlDecoder = static_cast<subttxrend::ctrl::TtmlController *>(mDecoder.get());
         ttmlDecoder->setCustomTtmlStyling(styling);
@@ -461,61 +896,270 @@ bool RenderSession::applyTtmlStyling(const std::string &styling) {
 
 // Thread function
 void RenderSession::processLoop() {
-    UniqueLock lock(mRenderMutex);
+    if (!applyRenderThreadSettings(mRenderThreadSettings, "TTRender", mLogger)) {
+        mRenderThreadSettingsApplied = false;
+    }
     while (!mQuitRenderThread) {
-        mRenderCond.wait(lock, [this]() { return mQuitRenderThread || (isRenderingActive() && isDataQueued()); });
+        if (!hasRenderWork()) {
+            mRenderDoorbell.wait(Doorbell::Priority::NORMAL, Doorbell::FOREVER, [this]() { return hasRenderWork(); });
+            continue;
+        }
+        processControlCommands();
+        if (!isRenderingActive()) {
+            processQueuedData();
+        }
 
         while (!mQuitRenderThread && isRenderingActive()) {
             const auto processWaitTime = processData();
-            mGfxEngine->execute();
+            commitFrame();
 
             if (processWaitTime == std::chrono::milliseconds::zero()) {
                 break;
             }
-            mRenderCond.wait_for(lock, processWaitTime, [this]() { return mQuitRenderThread; });
+            // New data waits for the next round, only commands cut it short
+            mRenderDoorbell.wait(Doorbell::Priority::URGENT, processWaitTime, [this]() { return mQuitRenderThread || hasControlCommands(); });
         }
-        mLogger.osdebug(__LOGGER_FUNC__, " no active controller, clearing the data queue");
-        LockGuard datalock{mDataMutex};
-        mDataQueue.clear();
     }
 }
 
+std::chrono::milliseconds RenderSession::runRenderStep() {
+    processControlCommands();
+    if (!isRenderingActive()) {
+        processQueuedData();
+    }
+    if (isRenderingActive()) {
+        const auto processWaitTime = processData();
+        commitFrame();
+        if (processWaitTime != std::chrono::milliseconds::zero()) {
+            return processWaitTime;
+        }
+    }
+    return hasRenderWork() ? std::chrono::milliseconds::zero() : Doorbell::FOREVER;
+}
+
+// Thread function
+void RenderSession::presentLoop() {
+    if (!applyRenderThreadSettings(mRenderThreadSettings, "TTPresent", mLogger)) {
+        mRenderThreadSettingsApplied = false;
+    }
+    while (!mQuitRenderThread) {
+        mPresentDoorbell.wait(Doorbell::Priority::NORMAL, Doorbell::FOREVER, [this]() { return mQuitRenderThread || mFramePending; });
+        presentPendingFrame();
+    }
+}
+
+void RenderSession::commitFrame() {
+    if (!mPipelined) {
+        mGfxEngine->execute();
+        return;
+    }
+    if (mFramePending.exchange(true)) {
+        // The present stage will pick this one up along with the one it has not got to
+        ++mCoalescedFrames;
+        return;
+    }
+    if (mRenderWorkers) {
+        mRenderWorkers->wake(mPresentTask, Doorbell::Priority::NORMAL);
+    } else {
+        mPresentDoorbell.ring(Doorbell::Priority::NORMAL);
+    }
+}
+
+void RenderSession::presentPendingFrame() {
+    if (mFramePending.exchange(false)) {
+        mGfxEngine->execute();
+    }
+}
+
+std::chrono::milliseconds RenderSession::PresentTask::runRenderStep() {
+    mSession.presentPendingFrame();
+    return Doorbell::FOREVER;
+}
+
 void RenderSession::onPacketReceived(const subttxrend::protocol::Packet &packet) {
     doOnPacketReceived(packet);
-    mRenderCond.notify_one();
+    wakeRenderThread(Doorbell::Priority::URGENT);
 }
 
-void RenderSession::addBuffer(subttxrend::common::DataBufferPtr buffer) {
-    if (isRenderingActive()) {
+void RenderSession::onCommand(std::function<void()> command) {
+    touchTime();
+    if (!mStarted) {
+        // No render thread to hand it to
+        LockGuard lock{mDecoderMutex};
+        command();
+        publishRenderingActive();
+        return;
+    }
+    // Counted once it can be taken, so that the render thread does not wait for it in vain
+    mControlMailbox.push(std::move(command));
+    ++mPendingControlCommands;
+    wakeRenderThread(Doorbell::Priority::URGENT);
+}
+
+void RenderSession::wakeRenderThread(Doorbell::Priority priority) {
+    if (mRenderWorkers) {
+        mRenderWorkers->wake(*this, priority);
+    } else {
+        mRenderDoorbell.ring(priority);
+    }
+}
+
+bool RenderSession::hasRenderWork() const {
+    // Queued data is work even without a decoder, it is dropped or a command ahead of it selects one
+    return mQuitRenderThread || hasControlCommands() || isDataQueued();
+}
+
+bool RenderSession::hasControlCommands() const {
+    return mPendingControlCommands.load() != 0;
+}
+
+void RenderSession::processControlCommands() {
+    std::function<void()> command;
+    // A command still being pushed is picked up on the next round, hasRenderWork keeps us coming back
+    while (hasControlCommands() && mControlMailbox.tryPop(command)) {
         {
-            LockGuard lock{mDataMutex};
-            mDataQueue.emplace_back(std::move(buffer));
+            LockGuard lock{mDecoderMutex};
+            command();
+            publishRenderingActive();
+        }
+        // Only now, so that acceptsData sees either the command or the decoder it selected
+        --mPendingControlCommands;
+    }
+}
+
+bool RenderSession::acceptsData() const {
+    // A selection may still be on its way to the render thread; processQueuedData applies it before the data
+    return isRenderingActive() || hasControlCommands();
+}
+
+void RenderSession::publishRenderingActive() {
+    mRenderingActive = mDecoder.get() != nullptr;
+}
+
+void RenderSession::addBuffer(subttxrend::common::DataBufferPtr buffer) {
+    if (acceptsData()) {
+        enqueueBuffer(std::move(buffer));
+        wakeRenderThread();
+    }
+}
+
+void RenderSession::addBuffers(std::vector<subttxrend::common::DataBufferPtr> &buffers) {
+    if (acceptsData()) {
+        for (auto &buffer : buffers) {
+            enqueueBuffer(std::move(buffer));
+        }
+        wakeRenderThread();
+    } else {
+        for (auto &buffer : buffers) {
+            mBufferPool.release(std::move(buffer));
         }
-        mRenderCond.notify_one();
     }
+    buffers.clear();
+}
+
+bool RenderSession::enqueueBuffer(subttxrend::common::DataBufferPtr buffer, Compression compression) {
+    // How long a BLOCK-ing producer waits for the render thread before giving up
+    constexpr auto blockTimeout = std::chrono::milliseconds(500);
+    const auto blockDeadline = std::chrono::steady_clock::now() + blockTimeout;
+    // A socket read on a render worker may hold up the very worker that would make room
+    const auto overflow = mDataQueueOverflow == DataQueueOverflow::BLOCK && RenderWorkerPool::isWorkerThread() ? DataQueueOverflow::DROP_OLDEST
+                                                                                                             : mDataQueueOverflow;
+    QueuedData data{std::move(buffer), compression, std::chrono::steady_clock::now()};
+    while (!mDataQueue.tryPush(data)) {
+        switch (overflow) {
+            case DataQueueOverflow::BLOCK:
+                if (std::chrono::steady_clock::now() < blockDeadline) {
+                    wakeRenderThread();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                break;
+            case DataQueueOverflow::DROP_OLDEST: {
+                QueuedData oldest;
+                if (mDataQueue.tryPop(oldest)) {
+                    mBufferPool.release(std::move(oldest.buffer));
+                    if (mDroppedBuffers++ % 100 == 0) {
+                        mLogger.oserror(__LOGGER_FUNC__, " data queue full, dropped oldest; total dropped ", mDroppedBuffers.load());
+                    }
+                }
+                continue;
+            }
+            case DataQueueOverflow::REJECT:
+                break;
+        }
+        if (mDroppedBuffers++ % 100 == 0) {
+            mLogger.oserror(__LOGGER_FUNC__, " data queue full, rejected data; total dropped ", mDroppedBuffers.load());
+        }
+        mBufferPool.release(std::move(data.buffer));
+        return false;
+    }
+    return true;
 }
 
 void RenderSession::onStreamBroken() {
     mLogger.oserror(__LOGGER_FUNC__, " something wrong with the stream");
+    // Called on the source thread, which the source must be able to join, so leave it to reconnectLoop
+    {
+        LockGuard lock{mReconnectMutex};
+        mStreamBroken = true;
+    }
+    mReconnectCond.notify_one();
 }
 
-std::chrono::milliseconds RenderSession::processData() {
+void RenderSession::reconnectLoop() {
+    // A source that breaks again this soon after being replaced gets the next longer delay
+    constexpr auto stableTime = std::chrono::seconds(5);
+    constexpr auto minDelay = std::chrono::milliseconds(10);
+    constexpr auto maxDelay = std::chrono::milliseconds(2000);
+    auto delay = std::chrono::milliseconds::zero();
+    auto lastReconnect = std::chrono::steady_clock::time_point{};
+
+    UniqueLock lock{mReconnectMutex};
     while (true) {
-        subttxrend::common::DataBufferPtr buffer;
-        {
-            LockGuard lock{mDataMutex};
-            if (!mDataQueue.empty()) {
-                buffer = std::move(mDataQueue.front());
-                mDataQueue.pop_front();
-            } else {
-                break;
-            }
+        mReconnectCond.wait(lock, [this]() { return mStopReconnect || mStreamBroken; });
+        if (mStopReconnect) {
+            break;
         }
-        if (buffer) {
-            const auto &packet = mParser.parse(std::move(buffer));
-            doOnPacketReceived(packet);
+        // The first retry is immediate, so a restarting producer finds the socket again at once
+        if (std::chrono::steady_clock::now() - lastReconnect > stableTime) {
+            delay = std::chrono::milliseconds::zero();
+        } else {
+            delay = std::min(std::max(delay * 2, minDelay), maxDelay);
+        }
+        if (mReconnectCond.wait_for(lock, delay, [this]() { return mStopReconnect; })) {
+            break;
+        }
+        mStreamBroken = false;
+        lock.unlock();
+
+        // Only the socket is replaced; the decoder, window, font cache and queued data stay as they are
+        mLogger.osinfo(__LOGGER_FUNC__, " reopening ", mSocketName, " after ", delay.count(), " ms");
+        // Gone already if the last attempt could not create it
+        if (mSocket) {
+            mSocket->stop();
+            mSocket.reset();
+        }
+        unlink(mSocketName.c_str());
+        const bool opened = openSocket();
+        lastReconnect = std::chrono::steady_clock::now();
+        if (opened) {
+            ++mSocketReconnects;
+        }
+
+        lock.lock();
+        if (!opened) {
+            mLogger.oserror(__LOGGER_FUNC__, " cannot recreate socket source, retrying");
+            mStreamBroken = true;
         }
     }
+}
+
+std::chrono::milliseconds RenderSession::processData() {
+    processControlCommands();
+    processQueuedData();
+#if TEXTTRACK_WITH_CCHAL
+    processCcData();
+#endif
     {
         LockGuard lock{mDecoderMutex};
         if (mDecoder) {
@@ -526,11 +1170,119 @@ std::chrono::milliseconds RenderSession::processData() {
     }
 }
 
-void RenderSession::doOnPacketReceived(const subttxrend::protocol::Packet &packet) {
-    using namespace subttxrend;
+void RenderSession::processQueuedData() {
+    QueuedData data;
+    while (mDataQueue.tryPop(data)) {
+        // Control commands go first, however much data is waiting. Taken after the data, they
+        // include all that were sent before it, such as the selection it was accepted for.
+        if (hasControlCommands()) {
+            // What was taken before them still goes to the decoder it was meant for
+            processLatePes();
+            processControlCommands();
+        }
+        auto buffer = std::move(data.buffer);
+        if (!isRenderingActive()) {
+            mBufferPool.release(std::move(buffer));
+            continue;
+        }
+        if (buffer && mMaxDataLatency != std::chrono::milliseconds::zero()) {
+            LockGuard lock{mDecoderMutex};
+            if (holdLatePes(buffer)) {
+                continue;
+            }
+            stripExpiredData(*buffer, data.queuedAt);
+        }
+        processLatePes();
+        if (buffer) {
+            decodeQueuedPacket(std::move(buffer), data.compression);
+        }
+    }
+    processLatePes();
+#if TEXTTRACK_WITH_CCHAL
+    if (!isRenderingActive()) {
+        mCcDataRing.clear();
+    }
+#endif
+}
+
+void RenderSession::decodeQueuedPacket(subttxrend::common::DataBufferPtr buffer, Compression compression) {
+    if (compression != Compression::NONE) {
+        buffer = decompressPacket(std::move(buffer), compression);
+    }
+    if (buffer) {
+        const auto &packet = mParser.parse(std::move(buffer));
+        doOnPacketReceived(packet);
+    }
+}
 
+bool RenderSession::holdLatePes(subttxrend::common::DataBufferPtr &buffer) {
+    using subttxrend::protocol::Packet;
+    const std::size_t headerSize = getDataHeaderSize(DataType::PES);
+    if (buffer->size() <= headerSize) {
+        return false;
+    }
+    uint32_t type = 0;
+    std::memcpy(&type, buffer->data(), sizeof(type));
+    if (static_cast<Packet::Type>(type) != Packet::Type::PES_DATA) {
+        return false;
+    }
+    const auto *pes = reinterpret_cast<const uint8_t *>(buffer->data()) + headerSize;
+    const std::size_t size = buffer->size() - headerSize;
+    // Teletext pages are built up from packets that each change a part of them, so teletext and
+    // anything else that is not DVB subtitles is decoded however late it is
+    std::vector<uint16_t> pages;
+    std::vector<uint16_t> completePages;
+    if (!getDvbSubtitlePages(pes, size, pages, completePages)) {
+        return false;
+    }
+    // A display set that carries its whole page makes the late ones of that page before it moot
+    const auto isSuperseded = [&completePages](const LatePes &late) {
+        return !late.pages.empty() && std::all_of(late.pages.begin(), late.pages.end(), [&completePages](uint16_t page) {
+            return std::find(completePages.begin(), completePages.end(), page) != completePages.end();
+        });
+    };
+    for (auto it = mLatePes.begin(); it != mLatePes.end();) {
+        if (!isSuperseded(*it)) {
+            ++it;
+            continue;
+        }
+        mBufferPool.release(std::move(it->buffer));
+        it = mLatePes.erase(it);
+        if (mExpiredPackets++ % 100 == 0) {
+            mLogger.osinfo(__LOGGER_FUNC__, " session is behind, skipping superseded subtitles; total expired ", mExpiredPackets.load());
+        }
+    }
+    // Due when the STC reaches its PTS
+    uint32_t pts = 0;
+    if (!mHasStc || !readPesPts(pes, size, pts)) {
+        return false;
+    }
+    // Both wrap, so compare the difference
+    const int32_t lateTicks = static_cast<int32_t>(mStcProvider.getStc() - pts);
+    if (lateTicks / 90 <= mMaxDataLatency.count()) {
+        return false;
+    }
+    mLatePes.push_back(LatePes{std::move(buffer), std::move(pages)});
+    return true;
+}
+
+void RenderSession::processLatePes() {
+    for (auto &late : mLatePes) {
+        decodeQueuedPacket(std::move(late.buffer), Compression::NONE);
+    }
+    mLatePes.clear();
+}
+
+void RenderSession::doOnPacketReceived(const subttxrend::protocol::Packet &packet) {
     LockGuard lock{mDecoderMutex};
     touchTime();
+    processPacket(packet);
+    publishRenderingActive();
+}
+
+void RenderSession::processPacket(const subttxrend::protocol::Packet &packet) {
+    using namespace subttxrend;
+
     switch (packet.getType()) {
         case protocol::Packet::Type::SUBTITLE_SELECTION:
         case protocol::Packet::Type::TELETEXT_SELECTION:
@@ -551,12 +1303,16 @@ void RenderSession::doOnPacketReceived(const subttxrend::protocol::Packet &packe
             break;
         }
         case protocol::Packet::Type::RESET_CHANNEL: {
-            processResetChannel(static_cast<const protocol::PacketResetChannel &>(packet));
+#if TEXTTRACK_WITH_CCHAL
+            dissociateVideoDecoder();
+#endif
+            processResetChannel(mDecoder && mDecoder->wantsData(static_cast<const protocol::PacketResetChannel &>(packet)));
             break;
         }
         case protocol::Packet::Type::TIMESTAMP: {
             const auto &timestampPacket = static_cast<const protocol::PacketTimestamp &>(packet);
             mStcProvider.processTimestamp(timestampPacket.getStc(), timestampPacket.getTimestamp());
+            mHasStc = true;
             break;
         }
         case protocol::Packet::Type::TTML_TIMESTAMP: {
@@ -568,19 +1324,19 @@ void RenderSession::doOnPacketReceived(const subttxrend::protocol::Packet &packe
             break;
         }
         case protocol::Packet::Type::PAUSE: {
-            processPause(static_cast<const protocol::PacketPause &>(packet));
+            processPause();
             break;
         }
         case protocol::Packet::Type::RESUME: {
-            processResume(static_cast<const protocol::PacketResume &>(packet));
+            processResume();
             break;
         }
         case protocol::Packet::Type::MUTE: {
-            processMutePacket(static_cast<const protocol::PacketMute &>(packet));
+            processMute();
             break;
         }
         case protocol::Packet::Type::UNMUTE: {
-            processUnmutePacket(static_cast<const protocol::PacketUnmute &>(packet));
+            processUnmute();
             break;
         }
         case protocol::Packet::Type::TTML_INFO: {
@@ -621,7 +1377,7 @@ void RenderSession::processDecoderSelection(const subttxrend::protocol::PacketCh
                     mDecoder.reset(ccDecoder);
                     mSessionType = SessionType::CC;
                     if (mCustomCcStyling.has_value()) {
-                        applyCcStyling(*mCustomCcStyling);
+                        processCcStyling(*mCustomCcStyling);
                     }
                     if (!mPreviewText.empty()) {
                         ccDecoder->setTextForPreview(mPreviewText);
@@ -663,25 +1419,32 @@ void RenderSession::processDecoderSelection(const subttxrend::protocol::PacketCh
     }
     if (mDecoder) {
         mDecoder->mute(mIsMuted);
+        mDecoderChannelId = packet.getChannelId();
     }
-    mLogger.osinfo("DecoderSelection ends mDecoder=", mDecoder.get(), " mSessionType=", static_cast<int>(mSessionType));
+    mLogger.osinfo("DecoderSelection ends mDecoder=", mDecoder.get(), " mSessionType=", static_cast<int>(mSessionType.load()));
 }
 
 void RenderSession::processDataPacket(const subttxrend::protocol::PacketData &packet) {
-    if (mDecoder) {
-        mDecoder->addData(packet);
+    if (!mDecoder) {
+        return;
     }
+    // A socket can carry several channels, only the selected one goes to the decoder
+    if (!mDecoder->wantsData(packet)) {
+        ++mOtherChannelPackets;
+        return;
+    }
+    mDecoder->addData(packet);
 }
 
-void RenderSession::processMutePacket(const subttxrend::protocol::PacketMute &packet) {
+void RenderSession::processMute() {
     if (mDecoder) {
         mDecoder->mute(true);
         mIsMuted = true;
     }
 }
 
-void RenderSession::processUnmutePacket(const subttxrend::protocol::PacketUnmute &packet) {
-    mLogger.osinfo("Unmute mDecoder=", mDecoder.get(), " mSessionType=", static_cast<int>(mSessionType));
+void RenderSession::processUnmute() {
+    mLogger.osinfo("Unmute mDecoder=", mDecoder.get(), " mSessionType=", static_cast<int>(mSessionType.load()));
     if (mDecoder) {
         mDecoder->mute(false);
         mIsMuted = false;
@@ -696,38 +1459,36 @@ void RenderSession::processSetCCAttributes(const subttxrend::protocol::PacketSet
 
 void RenderSession::processResetAll(const subttxrend::protocol::PacketResetAll &packet) {
     if (mDecoder) {
-        {
-            LockGuard lock{mDataMutex};
-            mDataQueue.clear();
-        }
+        clearDataQueue();
         mDecoder->deactivate();
         mDecoder.reset();
     }
+    mHasStc = false;
 }
 
-void RenderSession::processResetChannel(const subttxrend::protocol::PacketResetChannel &packet) {
-#if TEXTTRACK_WITH_CCHAL
-    dissociateVideoDecoder();
-#endif
-    if (mDecoder) {
-        if (mDecoder->wantsData(packet)) {
-            mDecoder->deactivate();
-            mDecoder.reset();
-        }
+void RenderSession::processResetChannel(bool resetDecoder) {
+    if (mDecoder && resetDecoder) {
+        mDecoder->deactivate();
+        mDecoder.reset();
+        mHasStc = false;
     }
     mIsMuted = true;
+    {
+        LockGuard lock{mCcFilterMutex};
+        mCcPreFilter.reset();
+    }
     mCustomCcStyling.reset();
     mPreviewText.clear();
     mCustomTtmlStyling.clear();
 }
 
-void RenderSession::processPause(const subttxrend::protocol::PacketPause &packet) {
+void RenderSession::processPause() {
     if (mDecoder) {
         mDecoder->pause();
     }
 }
 
-void RenderSession::processResume(const subttxrend::protocol::PacketResume &packet) {
+void RenderSession::processResume() {
     if (mDecoder) {
         mDecoder->resume();
     }
@@ -752,21 +1513,113 @@ void RenderSession::processTtmlInfo(const subttxrend::protocol::PacketTtmlInfo &
 }
 
 bool RenderSession::isRenderingActive() const {
-    LockGuard lock{mDecoderMutex};
-    return mDecoder.get() != nullptr;
+    // Called by API threads for every piece of data, which must not wait for a decoder that is busy rendering
+    return mRenderingActive.load();
 }
 
 bool RenderSession::isDataQueued() const {
-    LockGuard lock{mDataMutex};
+#if TEXTTRACK_WITH_CCHAL
+    if (!mCcDataRing.empty()) {
+        return true;
+    }
+#endif
     return !mDataQueue.empty();
 }
 
+void RenderSession::clearDataQueue() {
+    QueuedData data;
+    while (mDataQueue.tryPop(data)) {
+        mBufferPool.release(std::move(data.buffer));
+    }
+#if TEXTTRACK_WITH_CCHAL
+    mCcDataRing.clear();
+#endif
+}
+
+subttxrend::common::DataBufferPtr RenderSession::decompressPacket(subttxrend::common::DataBufferPtr packet, Compression compression) {
+    using subttxrend::protocol::Packet;
+    // Anything bigger is not a subtitle document, but a broken or malicious payload
+    constexpr std::size_t maxDecompressedSize = 16 * 1024 * 1024;
+    // Packet size field; counts the bytes after it
+    constexpr std::size_t sizeOffset = 8;
+    constexpr std::size_t sizeEnd = 12;
+
+    std::size_t headerSize = 0;
+    if (packet->size() >= sizeEnd) {
+        uint32_t type = 0;
+        std::memcpy(&type, packet->data(), sizeof(type));
+        switch (static_cast<Packet::Type>(type)) {
+            case Packet::Type::PES_DATA:
+                headerSize = getDataHeaderSize(DataType::PES);
+                break;
+            case Packet::Type::TTML_DATA:
+                headerSize = getDataHeaderSize(DataType::TTML);
+                break;
+            case Packet::Type::WEBVTT_DATA:
+                headerSize = getDataHeaderSize(DataType::WEBVTT);
+                break;
+            case Packet::Type::CC_DATA:
+                headerSize = getDataHeaderSize(DataType::CC);
+                break;
+            default:
+                break;
+        }
+    }
+    if (headerSize == 0 || packet->size() < headerSize) {
+        mLogger.oserror(__LOGGER_FUNC__, " not a data packet");
+        mBufferPool.release(std::move(packet));
+        return nullptr;
+    }
+    const std::size_t compressedSize = packet->size() - headerSize;
+    // Subtitle text usually shrinks to a fifth or less; the buffer grows if it has to
+    auto result = mBufferPool.acquire(headerSize + compressedSize * 5);
+    result->assign(packet->begin(), packet->begin() + headerSize);
+    const bool ok = decompress(compression, packet->data() + headerSize, compressedSize, *result, maxDecompressedSize);
+    mBufferPool.release(std::move(packet));
+    if (!ok) {
+        mLogger.oserror(__LOGGER_FUNC__, " cannot decompress ", compressedSize, " bytes");
+        mBufferPool.release(std::move(result));
+        return nullptr;
+    }
+    const uint32_t size = result->size() - sizeEnd;
+    std::memcpy(result->data() + sizeOffset, &size, sizeof(size));
+    return result;
+}
+
+void RenderSession::stripExpiredData(subttxrend::common::DataBuffer &packet, std::chrono::steady_clock::time_point queuedAt) {
+    using subttxrend::protocol::Packet;
+    if (packet.size() < sizeof(uint32_t)) {
+        return;
+    }
+    uint32_t type = 0;
+    std::memcpy(&type, packet.data(), sizeof(type));
+    bool expired = false;
+    switch (static_cast<Packet::Type>(type)) {
+        case Packet::Type::CC_DATA: {
+            // Has no PTS of its own, it is due when it arrives
+            const std::size_t headerSize = getDataHeaderSize(DataType::CC);
+            if (packet.size() > headerSize && std::chrono::steady_clock::now() - queuedAt > mMaxDataLatency) {
+                expired = dropCcText(reinterpret_cast<uint8_t *>(packet.data()) + headerSize, packet.size() - headerSize);
+            }
+            break;
+        }
+        default:
+            // TTML and WebVTT documents carry their own cue times, which their controllers already
+            // go by. PES carries state that later packets build on, see holdLatePes, and so do
+            // all other packets.
+            break;
+    }
+    if (expired && mExpiredPackets++ % 100 == 0) {
+        mLogger.osinfo(__LOGGER_FUNC__, " session is behind, skipping expired data; total expired ", mExpiredPackets.load());
+    }
+}
+
 #if TEXTTRACK_WITH_CCHAL
 extern "C" {
 // The callbacks we need for CC HAL
 void dataCallback(void *context, int decoderIndex, VL_CC_DATA_TYPE eType, unsigned char *ccData, unsigned dataLength, int sequenceNumber, long long localPts) {
     if (dataLength > 0) {
-        reinterpret_cast<RenderSession *>(context)->sendData(RenderSession::DataType::CC, std::string(reinterpret_cast<char *>(ccData), dataLength), 0);
+        reinterpret_cast<RenderSession *>(context)->addCcData(ccData, dataLength);
     }
 }
 void decodeCallback(void *context, int decoderIndex, int event) {
@@ -801,6 +1654,41 @@ void RenderSession::dissociateVideoDecoder() {
         mHasAssociatedVideoDecoder = false;
     }
 }
+
+void RenderSession::addCcData(const unsigned char *ccData, std::size_t size) {
+    if (mFilterCcData) {
+        LockGuard lock{mCcFilterMutex};
+        const std::size_t filtered = runCcPreFilter(ccData, size);
+        if (filtered != 0) {
+            writeCcData(reinterpret_cast<const unsigned char *>(mCcFilterOutput.data()), filtered);
+        }
+        return;
+    }
+    writeCcData(ccData, size);
+}
+
+void RenderSession::writeCcData(const unsigned char *ccData, std::size_t size) {
+    if (!mCcDataRing.write(ccData, size)) {
+        if (mDroppedBuffers++ % 100 == 0) {
+            mLogger.oserror(__LOGGER_FUNC__, " CC data ring full, dropped cc_data; total dropped ", mDroppedBuffers.load());
+        }
+        return;
+    }
+    // Costs next to nothing unless the render thread is idle; otherwise it finds the data on its next round
+    wakeRenderThread();
+}
+
+void RenderSession::processCcData() {
+    if (mCcDataRing.empty()) {
+        return;
+    }
+    auto buffer = createDataBuffer(DataType::CC, mCcDataRing.size());
+    mCcDataRing.readAll(*buffer);
+    if (auto packet = buildDataPacket(DataType::CC, std::move(buffer), 0)) {
+        const auto &parsed = mParser.parse(std::move(packet));
+        doOnPacketReceived(parsed);
+    }
+}
 #endif
 
 } // namespace Plugin
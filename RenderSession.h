@@ -18,10 +18,12 @@
  *  limitations under the License.
  */
 
+#pragma once
+
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
-#include <deque>
+#include <functional>
 #include <mutex>
 #include <optional>
 #include <string>
@@ -46,6 +48,21 @@
 #include <subttxrend/socksrc/PacketReceiver.hpp>
 #include <subttxrend/socksrc/Source.hpp>
 #include <thread>
+#include <vector>
+
+#include "BatchSocketSource.h"
+#include "BoundedQueue.h"
+#include "ByteRing.h"
+#include "CcPreFilter.h"
+#include "DataBufferPool.h"
+#include "Decompression.h"
+#include "Doorbell.h"
+#include "Mailbox.h"
+#include "PesAssembler.h"
+#include "RenderThreadSettings.h"
+#include "RenderWorkerPool.h"
+#include "SharedMemorySource.h"
+#include "SidecarFile.h"
 
 namespace subttxrend::ctrl {
 class Configuration;
@@ -54,6 +71,9 @@ class Configuration;
 namespace WPEFramework {
 namespace Plugin {
 
+// Channel id of all packets that a session builds itself
+constexpr uint32_t SESSION_CHANNEL_ID = 1;
+
 struct SubttxClosedCaptionsStyle {
     uint32_t fontColor = static_cast<uint32_t>(-1);
     uint32_t fontOpacity = static_cast<uint32_t>(-1);
@@ -67,7 +87,80 @@ struct SubttxClosedCaptionsStyle {
     uint32_t windowOpacity = static_cast<uint32_t>(-1);
 };
 
-class RenderSession : public subttxrend::socksrc::PacketReceiver {
+// What to do with new data when the data queue of a session is full
+enum class DataQueueOverflow {
+    // Wait for the render thread to make room, give up after a while. Sockets read by render
+    // workers drop the oldest instead, as the worker may be the one that would make room.
+    BLOCK,
+    // Discard the oldest queued data to make room
+    DROP_OLDEST,
+    // Refuse the new data, the caller gets an error
+    REJECT
+};
+
+// What became of data handed to a session
+enum class SendResult {
+    // Queued, or dropped on purpose, e.g. because no decoder is selected
+    ACCEPTED,
+    // Not a data packet that could be built
+    BAD_DATA,
+    // Refused because the data queue was full, see DataQueueOverflow
+    QUEUE_FULL
+};
+
+// Per-session settings that come from the plugin configuration
+struct RenderSessionSettings {
+    std::size_t dataQueueCapacity = 256;
+    DataQueueOverflow dataQueueOverflow = DataQueueOverflow::DROP_OLDEST;
+    // Size of the ring created by openSharedMemory
+    std::size_t sharedMemorySize = 256 * 1024;
+    // Read the socket with BatchSocketSource rather than socksrc::UnixSocketSource
+    bool batchedSocket = false;
+    // Run CC data through CcPreFilter before it is queued
+    bool ccPreFilter = false;
+    // How late queued data may be before it is dropped unseen, zero to decode everything
+    std::chrono::milliseconds maxDataLatency{0};
+    // Run the session as a task on this pool instead of on a render thread of its own
+    RenderWorkerPool *renderWorkers = nullptr;
+    // For the render thread of its own, the pool has its own
+    RenderThreadSettings renderThread;
+    // Present what was decoded on a thread or task of its own, so that decoding goes on meanwhile
+    bool pipelinedRendering = false;
+    // On renderWorkers: serve the session before all others, and how much CPU time per second
+    // it can use before it goes after all others, zero for no limit
+    bool renderFirst = false;
+    std::chrono::milliseconds renderCpuBudget{0};
+};
+
+struct RenderSessionStatistics {
+    // Data packets lost to a full data queue
+    uint64_t droppedPackets = 0;
+    // Data packets skipped, in whole or in part, because they were past their time
+    uint64_t expiredPackets = 0;
+    // Times the render thread was woken up in the last second
+    uint32_t wakeupsPerSecond = 0;
+    // Times the socket source was recreated after it broke
+    uint64_t socketReconnects = 0;
+    // CC data that went into and came out of CcPreFilter
+    uint64_t ccFilterInputBytes = 0;
+    uint64_t ccFilterOutputBytes = 0;
+    // Data packets discarded because they were for a channel other than the selected decoder's
+    uint64_t otherChannelPackets = 0;
+    // PES packets dropped unfinished because their channel started a new one
+    uint64_t incompletePesPackets = 0;
+    // How late the render timeouts fired on average and at most, only on a RenderWorkerPool
+    uint32_t averageTimerErrorUs = 0;
+    uint32_t maxTimerErrorUs = 0;
+    // CPU time spent rendering, and seconds in which that went over the budget, only on a RenderWorkerPool
+    uint64_t renderCpuTimeUs = 0;
+    uint64_t overBudgetSeconds = 0;
+    // False if the thread that renders could not be given all of RenderThreadSettings
+    bool renderThreadSettingsApplied = true;
+    // Decoded frames that were presented together with a later one, as presenting had not caught up
+    uint64_t coalescedFrames = 0;
+};
+
+class RenderSession : public BatchPacketReceiver, public RenderTask {
 public:
     enum class SessionType {
         NONE,
@@ -88,8 +181,8 @@ public:
         CEA608 = 0,
         CEA708 = 1
     };
-    RenderSession(subttxrend::ctrl::Configuration &configuration, std::string displayName, std::string socketName);
-    RenderSession(subttxrend::ctrl::Configuration &configuration, std::string displayName);
+    RenderSession(subttxrend::ctrl::Configuration &configuration, const RenderSessionSettings &settings, std::string displayName, std::string socketName);
+    RenderSession(subttxrend::ctrl::Configuration &configuration, const RenderSessionSettings &settings, std::string displayName);
     virtual ~RenderSession();
     RenderSession(const RenderSession &) = delete;
     RenderSession &operator=(const RenderSession &) = delete;
@@ -104,7 +197,35 @@ public:
     std::string getSocketName() const;
     void touchTime();
     std::chrono::steady_clock::time_point getLastActiveTime() const;
-    bool sendData(DataType type, const std::string &data, int64_t offsetMs);
+    // Size of the packet header that sendData writes in front of the payload of the given type
+    static std::size_t getDataHeaderSize(DataType type);
+    // Returns an empty packet with the header room in place and capacity for payloadSize bytes.
+    // Append the payload and pass it to sendData to get it queued without further copies.
+    subttxrend::common::DataBufferPtr createDataBuffer(DataType type, std::size_t payloadSize);
+    // Takes over a buffer from createDataBuffer and fills in the header in place.
+    // A compressed payload is decompressed by the render thread.
+    SendResult sendData(DataType type, subttxrend::common::DataBufferPtr buffer, int64_t offsetMs, Compression compression = Compression::NONE);
+    struct DataEntry {
+        DataType type;
+        // From createDataBuffer, with the payload appended
+        subttxrend::common::DataBufferPtr buffer;
+        int64_t offsetMs;
+        Compression compression = Compression::NONE;
+    };
+    // Queues all entries in order and wakes the render thread once; if any of them was refused, tells why the first one was
+    SendResult sendDataBatch(std::vector<DataEntry> entries);
+    // Whether PES data, without packet header, is for the decoder that is selected, going by the
+    // data_identifier of its payload. Lets callers discard other channels before copying them.
+    // Only data that is exactly one whole packet can be discarded this way; other data is always
+    // wanted, and sendData drops the packets of other channels after joining the pieces.
+    bool wantsPesData(const char *pes, std::size_t size) const;
+    // Creates a shared memory ring the player can write packets into, see SharedMemoryRingHeader.
+    // Only one per session; returns false if it could not be created.
+    bool openSharedMemory(const std::string &name);
+    std::string getSharedMemoryName() const;
+    // Feeds the cues of an opened WebVTT or TTML file to the decoder as sendTimestamp advances,
+    // instead of the data being sent. Replaces any previous file.
+    void setSidecarFile(std::shared_ptr<SidecarFile> file, int64_t offsetMs);
     void sendTimestamp(uint64_t iMediaTimestampMs);
     void pause();
     void resume();
@@ -118,79 +239,238 @@ public:
     void selectTtmlService(uint32_t iVideoWidth, uint32_t iVideoHeight);
     void selectScteService();
     void setTextForClosedCaptionPreview(const std::string &text);
-    void refreshClosedCaptionPreview();
     bool isRenderingActive() const;
     SessionType getSessionType() const;
+    RenderSessionStatistics getStatistics() const;
     // Only applies to CC session
     // Sets and applies a session-local override and remembers it across calls to selectCcService
     void setCustomCcStyling(const SubttxClosedCaptionsStyle &styling);
-    bool hasCustomCcStyling() const;
     // Applies a CC styling for the current instance of CC, will be gone if selectCcService is called
+    // Does nothing if the session has a custom styling
     void applyCcStyling(const SubttxClosedCaptionsStyle &styling);
     // Only applies to TTML session
-    // Sets and applies a session-local override and remembers it across calls to selectTtmlService
+    // Sets and applies a session-local override and remembers it across calls to selectTtmlService.
+    // Returns at once; false if TTML is not selected.
     bool setCustomTtmlStyling(const std::string &styling);
-    bool hasCustomTtmlStyling() const;
     // Applies a TTML styling for the current instance of TTML subtitles, will be gone if selectTtmlService is called
-    bool applyTtmlStyling(const std::string &styling);
+    // Does nothing if the session has a custom styling
+    void applyTtmlStyling(const std::string &styling);
 
     // Functions from PacketReceiver interface
     virtual void onPacketReceived(const subttxrend::protocol::Packet &packet) override;
     virtual void addBuffer(subttxrend::common::DataBufferPtr buffer) override;
     virtual void onStreamBroken() override;
+    // From BatchPacketReceiver
+    virtual void addBuffers(std::vector<subttxrend::common::DataBufferPtr> &buffers) override;
+    // From RenderTask, one round of processLoop when on a RenderWorkerPool
+    std::chrono::milliseconds runRenderStep() override;
 
 #if TEXTTRACK_WITH_CCHAL
     bool associateVideoDecoder(const std::string &handle);
     void dissociateVideoDecoder();
+    // Called on the CC HAL thread with the cc_data of a video frame; the render thread picks it up on its next round
+    void addCcData(const unsigned char *ccData, std::size_t size);
 #endif
 private:
+#if TEXTTRACK_WITH_CCHAL
+    void writeCcData(const unsigned char *ccData, std::size_t size);
+#endif
     using LockGuard = std::lock_guard<std::mutex>;
     using UniqueLock = std::unique_lock<std::mutex>;
 
     void processLoop();
+    // Thread function of the present stage, with pipelinedRendering and without render workers
+    void presentLoop();
+    // Presents what was just decoded, or hands it to the present stage
+    void commitFrame();
+    // Present stage; shows the latest decoded state of the window, if there is a new one
+    void presentPendingFrame();
+    // Creates and starts mSocket; false if the source could not be created
+    bool openSocket();
+    // Thread function: recreates mSocket with backoff whenever the source reports it broke
+    void reconnectLoop();
     std::chrono::milliseconds processData();
+    // Hands queued data to the decoder, each piece after the commands sent before it; drops it without a decoder
+    void processQueuedData();
     bool isDataQueued() const;
+    // Queues buffer for the render thread according to the overflow policy; false if it was refused.
+    // BLOCK only waits on threads other than render workers, which drop the oldest instead.
+    bool enqueueBuffer(subttxrend::common::DataBufferPtr buffer, Compression compression = Compression::NONE);
+    // Replaces the compressed payload of a data packet by its decompressed form; nullptr if that failed
+    subttxrend::common::DataBufferPtr decompressPacket(subttxrend::common::DataBufferPtr packet, Compression compression);
+    // Decompresses a queued packet if needed and hands it to the decoder
+    void decodeQueuedPacket(subttxrend::common::DataBufferPtr buffer, Compression compression);
+    // Call with mDecoderMutex acquired
+    // Takes a DVB subtitle PES that is past its time into mLatePes, true if it did. Drops those held
+    // there that a display set in buffer supersedes, the others are decoded by processLatePes.
+    bool holdLatePes(subttxrend::common::DataBufferPtr &buffer);
+    // Decodes what holdLatePes kept, late as it is
+    void processLatePes();
+    // Call with mDecoderMutex acquired
+    // Removes what is past its time from a data packet, keeping what changes the state of the decoder
+    void stripExpiredData(subttxrend::common::DataBuffer &packet, std::chrono::steady_clock::time_point queuedAt);
+    // Drops all queued data and hands the buffers back to the pool
+    void clearDataQueue();
+    // Fills in the packet header of a buffer from createDataBuffer; nullptr if that was not possible
+    subttxrend::common::DataBufferPtr buildDataPacket(DataType type, subttxrend::common::DataBufferPtr buffer, int64_t offsetMs);
+    // Whether a whole PES packet, without packet header, is for the decoder that is selected
+    bool wantsPesChannel(const char *pes, std::size_t size) const;
+    // Whether a PES buffer from createDataBuffer holds data for a decoder that is not selected
+    bool isForOtherChannel(const subttxrend::common::DataBuffer &pesBuffer) const;
+    // Runs a piece of PES data through mPesAssembler and queues the packets it completes, if active.
+    // Sets queuedAny if any was queued; tells why, if one of them was refused.
+    SendResult queuePesData(subttxrend::common::DataBufferPtr buffer, bool active, bool &queuedAny);
+    // Drops a PES packet that was not sent in full, so that it is not joined with new data
+    void resetPesAssembler();
+    // Filters the payload of a CC buffer from createDataBuffer in place; false if nothing is left
+    bool filterCcPayload(subttxrend::common::DataBuffer &buffer);
+    // Call with mCcFilterMutex acquired; leaves the result at the start of mCcFilterOutput and returns its size
+    std::size_t runCcPreFilter(const uint8_t *ccData, std::size_t size);
+    // Wakes the render thread or worker; NORMAL for new data, which only wakes it if it is waiting for data
+    void wakeRenderThread(Doorbell::Priority priority = Doorbell::Priority::NORMAL);
+    // Whether the render thread has anything to do before it waits for the next ring
+    bool hasRenderWork() const;
     void doOnPacketReceived(const subttxrend::protocol::Packet &packet);
+    // Call with mDecoderMutex acquired
+    void processPacket(const subttxrend::protocol::Packet &packet);
+    // Queues command on the control lane; the render thread runs it with mDecoderMutex acquired
+    void onCommand(std::function<void()> command);
+    bool hasControlCommands() const;
+    void processControlCommands();
+    // Whether data from API calls and sockets is queued: with a decoder, or a command that may select one
+    bool acceptsData() const;
+    // Call with mDecoderMutex acquired, after anything that may have replaced mDecoder
+    void publishRenderingActive();
+    // Call with mDecoderMutex acquired
+    void processCcStyling(const SubttxClosedCaptionsStyle &styling);
+    void processPreviewRefresh();
+    bool processTtmlStyling(const std::string &styling);
     void processDecoderSelection(const subttxrend::protocol::PacketChannelSpecific &packet);
     void processDataPacket(const subttxrend::protocol::PacketData &packet);
-    void processMutePacket(const subttxrend::protocol::PacketMute &packet);
-    void processUnmutePacket(const subttxrend::protocol::PacketUnmute &packet);
+    void processMute();
+    void processUnmute();
     void processSetCCAttributes(const subttxrend::protocol::PacketSetCCAttributes &packet);
     void processResetAll(const subttxrend::protocol::PacketResetAll &packet);
-    void processResetChannel(const subttxrend::protocol::PacketResetChannel &packet);
+    // resetDecoder tells whether the reset is for the channel of the current decoder
+    void processResetChannel(bool resetDecoder);
     void processTtmlTimestamp(const subttxrend::protocol::PacketTtmlTimestamp &packet);
     void processWebvttTimestamp(const subttxrend::protocol::PacketWebvttTimestamp &packet);
-    void processPause(const subttxrend::protocol::PacketPause &packet);
-    void processResume(const subttxrend::protocol::PacketResume &packet);
+    void processPause();
+    void processResume();
     void processTtmlInfo(const subttxrend::protocol::PacketTtmlInfo &packet);
+    // Hands the decoder the sidecar cues that are due soon after mediaTimestampMs
+    void processSidecarTimestamp(uint64_t mediaTimestampMs);
+    // Selects the WebVTT or TTML service again, which leaves the decoder without any cues
+    void restartSidecarDecoder();
+#if TEXTTRACK_WITH_CCHAL
+    // Passes everything in mCcDataRing to the decoder as one CC packet
+    void processCcData();
+#endif
 
-    SessionType mSessionType = SessionType::NONE;
+    std::atomic<SessionType> mSessionType{SessionType::NONE};
     subttxrend::common::Logger mLogger;
     subttxrend::ctrl::Configuration &mConfiguration;
     std::string mDisplayName;
     std::string mSocketName;
     bool mStarted = false;
     std::atomic<std::chrono::steady_clock::time_point> mLastActiveTime;
+    const bool mBatchedSocket;
+    // Replaced by the reconnect thread while it runs, otherwise only touched by start and stop
     subttxrend::socksrc::SourcePtr mSocket;
+    // Protects mStreamBroken, mStopReconnect
+    std::mutex mReconnectMutex;
+    std::condition_variable mReconnectCond;
+    bool mStreamBroken = false;
+    bool mStopReconnect = false;
+    std::thread mReconnectThread;
+    std::atomic<uint64_t> mSocketReconnects{0};
+    const std::size_t mSharedMemorySize;
+    std::unique_ptr<SharedMemorySource> mSharedMemory;
     subttxrend::ctrl::StcProvider mStcProvider;
+    // Whether mStcProvider has had a timestamp since the last reset; protected by mDecoderMutex
+    bool mHasStc = false;
     std::string mPreviewText;
     std::optional<SubttxClosedCaptionsStyle> mCustomCcStyling;
     std::string mCustomTtmlStyling;
+    // Protected by mDecoderMutex
+    std::shared_ptr<SidecarFile> mSidecarFile;
+    int64_t mSidecarOffsetMs = 0;
+    std::optional<uint64_t> mSidecarTimeMs;
+    // Of the last WebVTT or TTML selection; protected by mDecoderMutex
+    uint32_t mVideoWidth = 0;
+    uint32_t mVideoHeight = 0;
     // Protects mDecoder, ...
     mutable std::mutex mDecoderMutex;
     std::unique_ptr<subttxrend::ctrl::ControllerInterface> mDecoder;
+    // Whether mDecoder is set, for threads that must not wait for mDecoderMutex
+    std::atomic<bool> mRenderingActive{false};
+    uint32_t mDecoderChannelId = 0;
     subttxrend::protocol::PacketParser mParser;
     subttxrend::gfx::EnginePtr mGfxEngine;
     subttxrend::gfx::WindowPtr mGfxWindow;
     std::shared_ptr<subttxrend::gfx::PrerenderedFontCache> mFontCache;
-    // Protects mQuitRenderThread, mRenderCond, ...
-    mutable std::mutex mRenderMutex;
-    bool mQuitRenderThread = false;
+    std::atomic<bool> mQuitRenderThread{false};
     std::thread mRenderThread;
-    std::condition_variable mRenderCond;
-    // Protects mDataQueue, ...
-    mutable std::mutex mDataMutex;
-    std::deque<subttxrend::common::DataBufferPtr> mDataQueue;
+    const RenderThreadSettings mRenderThreadSettings;
+    std::atomic<bool> mRenderThreadSettingsApplied{true};
+    // Runs the session instead of mRenderThread if set
+    RenderWorkerPool *const mRenderWorkers;
+    const RenderWorkerPool::Policy mRenderPolicy;
+    // Rung NORMAL for data, URGENT for control commands and quitting
+    Doorbell mRenderDoorbell;
+    // Present stage. The gfx window keeps the drawn scene apart from the one on screen, so
+    // handing a frame over is just this flag, and several decoded meanwhile go out as one.
+    class PresentTask : public RenderTask {
+    public:
+        explicit PresentTask(RenderSession &session) : mSession(session) {}
+        std::chrono::milliseconds runRenderStep() override;
+    private:
+        RenderSession &mSession;
+    };
+    const bool mPipelined;
+    std::atomic<bool> mFramePending{false};
+    std::atomic<uint64_t> mCoalescedFrames{0};
+    std::thread mPresentThread;
+    Doorbell mPresentDoorbell;
+    PresentTask mPresentTask{*this};
+    // Control lane: API commands for the render thread, applied before any queued data
+    Mailbox<std::function<void()>> mControlMailbox;
+    std::atomic<uint32_t> mPendingControlCommands{0};
+    // Data packets waiting for the render thread. Filled by API, socket and CC HAL threads, emptied by the render thread.
+    struct QueuedData {
+        subttxrend::common::DataBufferPtr buffer;
+        Compression compression = Compression::NONE;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+    const DataQueueOverflow mDataQueueOverflow;
+    BoundedQueue<QueuedData> mDataQueue;
+    std::atomic<uint64_t> mDroppedBuffers{0};
+    const std::chrono::milliseconds mMaxDataLatency;
+    std::atomic<uint64_t> mExpiredPackets{0};
+    // Late DVB subtitle PES that a later display set may still supersede; render thread only
+    struct LatePes {
+        subttxrend::common::DataBufferPtr buffer;
+        std::vector<uint16_t> pages;
+    };
+    std::vector<LatePes> mLatePes;
+    // Recycles packet buffers for BuildPacket and data we queue ourselves
+    DataBufferPool mBufferPool;
+    const bool mFilterCcData;
+    // Protects mCcPreFilter, mCcFilterOutput; CC data comes from API and CC HAL threads
+    std::mutex mCcFilterMutex;
+    CcPreFilter mCcPreFilter;
+    subttxrend::common::DataBuffer mCcFilterOutput;
+    std::atomic<uint64_t> mCcFilterInputBytes{0};
+    std::atomic<uint64_t> mCcFilterOutputBytes{0};
+    std::atomic<uint64_t> mOtherChannelPackets{0};
+    // Protects mPesAssembler; PES data comes from API calls
+    mutable std::mutex mPesMutex;
+    PesAssembler mPesAssembler{mBufferPool, getDataHeaderSize(DataType::PES)};
+#if TEXTTRACK_WITH_CCHAL
+    // cc_data triplets from the CC HAL thread, a couple of seconds worth
+    static constexpr std::size_t CC_DATA_RING_SIZE = 4096;
+    ByteRing mCcDataRing{CC_DATA_RING_SIZE};
+#endif
     bool mHasAssociatedVideoDecoder = false;
     bool mIsMuted = true;
 };
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#include "RenderThreadSettings.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <subttxrend/common/Logger.hpp>
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+// Including the terminating zero
+constexpr std::size_t MAX_THREAD_NAME = 16;
+
+bool applyPolicy(const RenderThreadSettings &settings, subttxrend::common::Logger &logger) {
+    int policy = SCHED_OTHER;
+    switch (settings.policy) {
+        case RenderThreadSettings::Policy::DEFAULT:
+            return true;
+        case RenderThreadSettings::Policy::OTHER:
+            policy = SCHED_OTHER;
+            break;
+        case RenderThreadSettings::Policy::FIFO:
+            policy = SCHED_FIFO;
+            break;
+        case RenderThreadSettings::Policy::RR:
+            policy = SCHED_RR;
+            break;
+    }
+    struct sched_param param {};
+    if (policy != SCHED_OTHER) {
+        param.sched_priority = std::min(std::max(settings.priority, sched_get_priority_min(policy)), sched_get_priority_max(policy));
+    }
+    const int error = pthread_setschedparam(pthread_self(), policy, &param);
+    if (error != 0) {
+        logger.oserror(__LOGGER_FUNC__, " - cannot set scheduling policy ", policy, " priority ", param.sched_priority, ": ", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool applyNice(const RenderThreadSettings &settings, subttxrend::common::Logger &logger) {
+    if (settings.nice == 0 || settings.policy == RenderThreadSettings::Policy::FIFO || settings.policy == RenderThreadSettings::Policy::RR) {
+        return true;
+    }
+    // On Linux the nice value belongs to the thread, not to the whole process
+    const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    if (setpriority(PRIO_PROCESS, tid, settings.nice) != 0) {
+        logger.oserror(__LOGGER_FUNC__, " - cannot set nice ", settings.nice, ", errno=", errno);
+        return false;
+    }
+    return true;
+}
+
+bool applyAffinity(const RenderThreadSettings &settings, subttxrend::common::Logger &logger) {
+    if (settings.affinityMask == 0) {
+        return true;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu != 64; ++cpu) {
+        if (settings.affinityMask & (uint64_t{1} << cpu)) {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (error != 0) {
+        logger.oserror(__LOGGER_FUNC__, " - cannot set CPU affinity mask ", settings.affinityMask, ": ", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool parseRenderThreadPolicy(const std::string &name, RenderThreadSettings::Policy &policy) {
+    if (name == "other") {
+        policy = RenderThreadSettings::Policy::OTHER;
+    } else if (name == "fifo") {
+        policy = RenderThreadSettings::Policy::FIFO;
+    } else if (name == "rr") {
+        policy = RenderThreadSettings::Policy::RR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool applyRenderThreadSettings(const RenderThreadSettings &settings, const std::string &name, subttxrend::common::Logger &logger) {
+    // pthread_setname_np refuses longer names
+    const std::string threadName = name.substr(0, MAX_THREAD_NAME - 1);
+    pthread_setname_np(pthread_self(), threadName.c_str());
+    // All of them, so that every problem is logged
+    const bool policyApplied = applyPolicy(settings, logger);
+    const bool niceApplied = applyNice(settings, logger);
+    const bool affinityApplied = applyAffinity(settings, logger);
+    return policyApplied && niceApplied && affinityApplied;
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
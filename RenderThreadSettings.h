@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace subttxrend {
+namespace common {
+class Logger;
+}
+} // namespace subttxrend
+
+namespace WPEFramework {
+namespace Plugin {
+
+// How the threads that render are scheduled, from the plugin configuration
+struct RenderThreadSettings {
+    enum class Policy {
+        // Leave the policy the thread was started with
+        DEFAULT,
+        OTHER,
+        FIFO,
+        RR
+    };
+    Policy policy = Policy::DEFAULT;
+    // Real-time priority, for FIFO and RR
+    int priority = 0;
+    // For OTHER and DEFAULT
+    int nice = 0;
+    // A bit per CPU the thread may run on, zero for any
+    uint64_t affinityMask = 0;
+};
+
+// "other", "fifo" or "rr"; false if the name is none of these
+bool parseRenderThreadPolicy(const std::string &name, RenderThreadSettings::Policy &policy);
+
+// Names the calling thread and applies the settings to it. Logs what could not be applied,
+// typically for lack of CAP_SYS_NICE, and returns false if anything was not.
+bool applyRenderThreadSettings(const RenderThreadSettings &settings, const std::string &name, subttxrend::common::Logger &logger);
+
+} // namespace Plugin
+} // namespace WPEFramework
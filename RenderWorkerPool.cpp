@@ -0,0 +1,420 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "RenderWorkerPool.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+constexpr std::size_t MAX_EVENTS = 16;
+// Period of CPU budgets
+constexpr auto BUDGET_PERIOD = std::chrono::seconds(1);
+// How far ahead of the others a task that slept gets back in line
+constexpr auto MAX_SLEEP_CREDIT = std::chrono::milliseconds(10);
+
+thread_local bool tIsWorkerThread = false;
+
+std::chrono::nanoseconds getThreadCpuTime() {
+    struct timespec time {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
+
+// Reads an eventfd or timerfd, so that it stops being readable
+void drain(int fd) {
+    uint64_t count = 0;
+    while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+}
+
+} // namespace
+
+RenderWorkerPool::RenderWorkerPool(std::size_t workers, std::chrono::milliseconds timerSlack, const RenderThreadSettings &threadSettings)
+    : mLogger("App", "RenderWorkerPool", this), mTimerSlack(timerSlack), mThreadSettings(threadSettings) {
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    bool ok = mEpollFd >= 0 && mWakeFd >= 0 && mTimerFd >= 0;
+    for (const int fd : {mWakeFd, mTimerFd}) {
+        // Exclusive, so that one signal or expiry gets one worker out of epoll_wait, not all
+        struct epoll_event event {};
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.fd = fd;
+        ok = ok && epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+    if (!ok) {
+        mLogger.oserror(__LOGGER_FUNC__, " - cannot set up epoll, errno=", errno);
+        for (const int fd : {mEpollFd, mWakeFd, mTimerFd}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        throw std::runtime_error("error while creating render workers");
+    }
+    workers = std::max<std::size_t>(workers, 1);
+    mWorkers.reserve(workers);
+    for (std::size_t i = 0; i != workers; ++i) {
+        mWorkers.emplace_back(&RenderWorkerPool::workerLoop, this, i);
+    }
+}
+
+RenderWorkerPool::~RenderWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mStop = true;
+    }
+    signalWorker();
+    for (auto &worker : mWorkers) {
+        worker.join();
+    }
+    ::close(mTimerFd);
+    ::close(mWakeFd);
+    ::close(mEpollFd);
+}
+
+void RenderWorkerPool::add(RenderTask &task, const Policy &policy) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    if (task.mState == RenderTask::State::REMOVED) {
+        task.mFirst = policy.first;
+        task.mCpuBudget = policy.cpuBudget;
+        task.mVirtualTime = mVirtualTime;
+        task.mBudgetPeriodStart = std::chrono::steady_clock::now();
+        task.mBudgetUsed = std::chrono::nanoseconds::zero();
+        task.mOverBudgetPeriods = 0;
+        start(task, task);
+    }
+}
+
+void RenderWorkerPool::add(RenderTask &task, RenderTask &owner) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    if (task.mState == RenderTask::State::REMOVED) {
+        task.mFirst = false;
+        task.mCpuBudget = std::chrono::nanoseconds::zero();
+        task.mOverBudgetPeriods = 0;
+        start(task, owner);
+    }
+}
+
+void RenderWorkerPool::remove(RenderTask &task) {
+    UniqueLock lock{mMutex};
+    task.mRemoving = true;
+    mRunDoneCond.wait(lock, [&task]() { return task.mState != RenderTask::State::RUNNING; });
+    if (task.mState == RenderTask::State::READY) {
+        mReady.erase(std::find(mReady.begin(), mReady.end(), &task));
+    }
+    // Timers only hold on to the task by pointer, stale ones included, so none may stay behind
+    mTimers.removeIf([&task](const Timer &timer) { return timer.task == &task; });
+    task.mState = RenderTask::State::REMOVED;
+}
+
+void RenderWorkerPool::wake(RenderTask &task, Doorbell::Priority priority) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    switch (task.mState) {
+        case RenderTask::State::IDLE:
+            makeReady(task);
+            break;
+        case RenderTask::State::TIMED:
+            if (priority == Doorbell::Priority::URGENT) {
+                makeReady(task);
+            }
+            break;
+        case RenderTask::State::RUNNING:
+            task.mWoken = true;
+            task.mWokenUrgent = task.mWokenUrgent || priority == Doorbell::Priority::URGENT;
+            break;
+        case RenderTask::State::REMOVED:
+        case RenderTask::State::READY:
+            break;
+    }
+}
+
+bool RenderWorkerPool::addFd(int fd, std::function<bool()> onReadable) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    if (mWatches.count(fd) != 0) {
+        return false;
+    }
+    // One shot, so that only one worker gets to read it; runWatch arms it again
+    struct epoll_event event {};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        mLogger.oserror(__LOGGER_FUNC__, " - cannot watch fd ", fd, ", errno=", errno);
+        return false;
+    }
+    auto watch = std::make_unique<Watch>();
+    watch->onReadable = std::move(onReadable);
+    mWatches.emplace(fd, std::move(watch));
+    return true;
+}
+
+void RenderWorkerPool::removeFd(int fd) {
+    UniqueLock lock{mMutex};
+    auto watch = mWatches.find(fd);
+    if (watch == mWatches.end()) {
+        return;
+    }
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+    watch->second->removed = true;
+    mRunDoneCond.wait(lock, [&watch]() { return !watch->second->running; });
+    mWatches.erase(watch);
+}
+
+std::size_t RenderWorkerPool::getWorkerCount() const {
+    return mWorkers.size();
+}
+
+bool RenderWorkerPool::areThreadSettingsApplied() const {
+    return mThreadSettingsApplied.load();
+}
+
+RenderWorkerPool::TaskStatistics RenderWorkerPool::getTaskStatistics(const RenderTask &task) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    TaskStatistics statistics;
+    statistics.timerFirings = task.mTimerFirings;
+    if (task.mTimerFirings != 0) {
+        statistics.averageTimerError = task.mTimerErrorTotal / task.mTimerFirings;
+    }
+    statistics.maxTimerError = task.mTimerErrorMax;
+    statistics.cpuTime = task.mCpuTime;
+    statistics.overBudgetPeriods = task.mOverBudgetPeriods;
+    return statistics;
+}
+
+bool RenderWorkerPool::isWorkerThread() {
+    return tIsWorkerThread;
+}
+
+void RenderWorkerPool::workerLoop(std::size_t index) {
+    tIsWorkerThread = true;
+    if (!applyRenderThreadSettings(mThreadSettings, "TTWorker" + std::to_string(index), mLogger)) {
+        mThreadSettingsApplied = false;
+    }
+    std::array<struct epoll_event, MAX_EVENTS> events{};
+    UniqueLock lock{mMutex};
+    while (!mStop) {
+        fireTimers(std::chrono::steady_clock::now());
+        if (!mReady.empty()) {
+            runTask(lock);
+            continue;
+        }
+        armTimer();
+        ++mIdleWorkers;
+        lock.unlock();
+        const int count = epoll_wait(mEpollFd, events.data(), events.size(), -1);
+        if (count < 0 && errno != EINTR) {
+            mLogger.oserror(__LOGGER_FUNC__, " - epoll_wait failed, errno=", errno);
+        }
+        lock.lock();
+        --mIdleWorkers;
+        for (int i = 0; i < count; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == mWakeFd) {
+                drain(mWakeFd);
+            } else if (fd == mTimerFd) {
+                drain(mTimerFd);
+                mArmedTime = std::chrono::steady_clock::time_point::max();
+            } else {
+                runWatch(lock, fd);
+            }
+        }
+    }
+    // Pass the stop on to the next worker
+    lock.unlock();
+    signalWorker();
+}
+
+void RenderWorkerPool::runTask(UniqueLock &lock) {
+    const auto next = pickReady(std::chrono::steady_clock::now());
+    RenderTask &task = **next;
+    mReady.erase(next);
+    if (!mReady.empty() && mIdleWorkers != 0) {
+        // One signal only gets one worker out, so hand on what we don't take
+        signalWorker();
+    }
+    task.mState = RenderTask::State::RUNNING;
+    task.mWoken = false;
+    task.mWokenUrgent = false;
+    RenderTask &account = *task.mAccount;
+    mVirtualTime = std::max(mVirtualTime, account.mVirtualTime);
+    lock.unlock();
+    const auto cpuStart = getThreadCpuTime();
+    const auto waitTime = task.runRenderStep();
+    const auto cpuTime = getThreadCpuTime() - cpuStart;
+    lock.lock();
+    task.mCpuTime += cpuTime;
+    account.mVirtualTime += cpuTime;
+    if (account.mCpuBudget != std::chrono::nanoseconds::zero()) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - account.mBudgetPeriodStart >= BUDGET_PERIOD) {
+            account.mBudgetPeriodStart = now;
+            account.mBudgetUsed = std::chrono::nanoseconds::zero();
+        }
+        const bool wasOverBudget = account.mBudgetUsed > account.mCpuBudget;
+        account.mBudgetUsed += cpuTime;
+        if (!wasOverBudget && account.mBudgetUsed > account.mCpuBudget) {
+            ++account.mOverBudgetPeriods;
+            mLogger.osdebug(__LOGGER_FUNC__, " - task ", &account, " is over its CPU budget, it goes last for now");
+        }
+    }
+    reschedule(task, waitTime);
+    mRunDoneCond.notify_all();
+}
+
+std::deque<RenderTask *>::iterator RenderWorkerPool::pickReady(std::chrono::steady_clock::time_point now) {
+    // First tasks, then those within budget, then those over it; by virtual time within each.
+    // Owned tasks rank as their owner.
+    const auto rank = [this, now](const RenderTask *task) {
+        const RenderTask &account = *task->mAccount;
+        const int group = account.mFirst ? 0 : isOverBudget(account, now) ? 2 : 1;
+        return std::make_pair(group, account.mVirtualTime);
+    };
+    // A handful of sessions at most, not worth keeping sorted; the first of equals keeps round-robin
+    return std::min_element(mReady.begin(), mReady.end(), [&rank](const RenderTask *a, const RenderTask *b) { return rank(a) < rank(b); });
+}
+
+bool RenderWorkerPool::isOverBudget(const RenderTask &task, std::chrono::steady_clock::time_point now) const {
+    return task.mCpuBudget != std::chrono::nanoseconds::zero() && task.mBudgetUsed > task.mCpuBudget && now - task.mBudgetPeriodStart < BUDGET_PERIOD;
+}
+
+void RenderWorkerPool::runWatch(UniqueLock &lock, int fd) {
+    const auto it = mWatches.find(fd);
+    // Gone, or an event from before removeFd; a running one gets armed again when done
+    if (it == mWatches.end() || it->second->running || it->second->removed) {
+        return;
+    }
+    Watch &watch = *it->second;
+    watch.running = true;
+    lock.unlock();
+    const bool keep = watch.onReadable();
+    lock.lock();
+    watch.running = false;
+    if (watch.removed) {
+        mRunDoneCond.notify_all();
+    } else if (keep) {
+        struct epoll_event event {};
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.fd = fd;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event) != 0) {
+            mLogger.oserror(__LOGGER_FUNC__, " - cannot watch fd ", fd, " again, errno=", errno);
+        }
+    }
+}
+
+void RenderWorkerPool::start(RenderTask &task, RenderTask &account) {
+    task.mTimerFirings = 0;
+    task.mTimerErrorTotal = std::chrono::microseconds::zero();
+    task.mTimerErrorMax = std::chrono::microseconds::zero();
+    task.mRemoving = false;
+    task.mAccount = &account;
+    task.mCpuTime = std::chrono::nanoseconds::zero();
+    makeReady(task);
+}
+
+void RenderWorkerPool::makeReady(RenderTask &task) {
+    if (task.mState != RenderTask::State::RUNNING) {
+        // Sleeping earns no more than a small head start
+        RenderTask &account = *task.mAccount;
+        account.mVirtualTime = std::max(account.mVirtualTime, mVirtualTime - std::chrono::nanoseconds(MAX_SLEEP_CREDIT));
+    }
+    // Leaves any timer of the task behind as stale
+    ++task.mTimerGeneration;
+    task.mState = RenderTask::State::READY;
+    mReady.push_back(&task);
+    if (mIdleWorkers != 0) {
+        signalWorker();
+    }
+}
+
+void RenderWorkerPool::fireTimers(std::chrono::steady_clock::time_point now) {
+    mTimers.advance(now, [this, now](std::chrono::steady_clock::time_point dueTime, const Timer &timer) {
+        RenderTask &task = *timer.task;
+        if (task.mState != RenderTask::State::TIMED || task.mTimerGeneration != timer.generation) {
+            return;
+        }
+        const auto error = std::chrono::duration_cast<std::chrono::microseconds>(now - dueTime);
+        ++task.mTimerFirings;
+        task.mTimerErrorTotal += error;
+        task.mTimerErrorMax = std::max(task.mTimerErrorMax, error);
+        makeReady(task);
+    });
+}
+
+void RenderWorkerPool::reschedule(RenderTask &task, std::chrono::milliseconds waitTime) {
+    if (task.mRemoving) {
+        task.mState = RenderTask::State::IDLE;
+    } else if (waitTime == std::chrono::milliseconds::zero() || task.mWokenUrgent) {
+        makeReady(task);
+    } else if (waitTime == Doorbell::FOREVER) {
+        if (task.mWoken) {
+            makeReady(task);
+        } else {
+            task.mState = RenderTask::State::IDLE;
+        }
+    } else {
+        task.mState = RenderTask::State::TIMED;
+        mTimers.add(std::chrono::steady_clock::now() + waitTime, {&task, ++task.mTimerGeneration});
+        // Other workers may be idle, waiting for a later timer
+        armTimer();
+    }
+}
+
+void RenderWorkerPool::armTimer() {
+    if (mTimers.empty()) {
+        return;
+    }
+    // Whatever else is due by then fires along with it
+    const auto fireTime = mTimers.getNextDueTime() + mTimerSlack;
+    if (fireTime >= mArmedTime) {
+        return;
+    }
+    mArmedTime = fireTime;
+    const auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(mArmedTime.time_since_epoch());
+    struct itimerspec expiry {};
+    expiry.it_value.tv_sec = sinceEpoch.count() / 1000000000;
+    expiry.it_value.tv_nsec = sinceEpoch.count() % 1000000000;
+    // steady_clock is CLOCK_MONOTONIC
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &expiry, nullptr) != 0) {
+        mLogger.oserror(__LOGGER_FUNC__, " - timerfd_settime failed, errno=", errno);
+    }
+}
+
+void RenderWorkerPool::signalWorker() {
+    const uint64_t one = 1;
+    if (write(mWakeFd, &one, sizeof(one)) != sizeof(one)) {
+        mLogger.oserror(__LOGGER_FUNC__, " - cannot signal a worker, errno=", errno);
+    }
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <subttxrend/common/Logger.hpp>
+#include <thread>
+#include <vector>
+
+#include "Doorbell.h"
+#include "RenderThreadSettings.h"
+#include "TimerWheel.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Work that a RenderWorkerPool runs a step at a time, on whichever worker is free
+class RenderTask {
+public:
+    virtual ~RenderTask() = default;
+    // Does what is due and returns how long until it wants to run again: zero to go to the back
+    // of the line right away, Doorbell::FOREVER to sleep until woken up
+    virtual std::chrono::milliseconds runRenderStep() = 0;
+private:
+    friend class RenderWorkerPool;
+    enum class State {
+        REMOVED,
+        IDLE,
+        READY,
+        TIMED,
+        RUNNING
+    };
+    // All protected by the mutex of the pool
+    State mState = State::REMOVED;
+    // A wake up while RUNNING, applied when the step is done
+    bool mWoken = false;
+    bool mWokenUrgent = false;
+    // Set by remove, so that a task that always has more to do is not put back in line
+    bool mRemoving = false;
+    // Tells a timer of the current TIMED state from stale ones
+    uint64_t mTimerGeneration = 0;
+    // How late timers of the task fired, since it was added
+    uint64_t mTimerFirings = 0;
+    std::chrono::microseconds mTimerErrorTotal{0};
+    std::chrono::microseconds mTimerErrorMax{0};
+    // The task whose policy, budget and virtual time this one runs on; itself unless added with an owner
+    RenderTask *mAccount = this;
+    // Scheduling, see RenderWorkerPool::Policy
+    bool mFirst = false;
+    std::chrono::nanoseconds mCpuBudget{0};
+    // CPU time of the steps of this task alone
+    std::chrono::nanoseconds mCpuTime{0};
+    // CPU time of the steps of the account with credit for sleeping taken off, to pick the next task by
+    std::chrono::nanoseconds mVirtualTime{0};
+    std::chrono::steady_clock::time_point mBudgetPeriodStart;
+    std::chrono::nanoseconds mBudgetUsed{0};
+    uint64_t mOverBudgetPeriods = 0;
+};
+
+// A fixed number of threads that take turns running the steps of many RenderTasks, so that
+// sessions stop costing a thread each. Wake ups follow Doorbell: while a task waits for its timeout, only URGENT ones cut it short.
+// A task never runs on two workers at once.
+//
+// Idle workers wait in one epoll set, together with the file descriptors added with addFd.
+// Timeouts of all tasks are kept in a TimerWheel and share one timerfd, and an eventfd is
+// signalled only when a task gets ready while a worker is idle. With a single worker this is
+// an event loop that drives all sessions, and their batched sockets, from one thread.
+//
+// The timerfd is armed timerSlack after the earliest timeout, and fires every timeout that is
+// due by then, so that tasks with nearly the same deadline are woken together. Timeouts are
+// never early; getTaskStatistics tells how late they were.
+//
+// Ready tasks are picked by fair share: the one that used the least CPU time in its steps goes
+// first, with a sleeping task let back in at most a little ahead of the others, so it cannot
+// save up for a burst. Tasks added as first go before all others. A task that has used up its
+// CPU budget for the current second goes after all others until the next second, instead of
+// being stopped, so that it only runs on what the others leave.
+class RenderWorkerPool {
+public:
+    struct Policy {
+        // Served before tasks that are not first, e.g. the session of the main player
+        bool first = false;
+        // CPU time per second the task can use before it is put last, zero for no limit
+        std::chrono::milliseconds cpuBudget{0};
+    };
+    struct TaskStatistics {
+        // How late timeouts were, from the deadline to when the task was made ready again
+        uint64_t timerFirings = 0;
+        std::chrono::microseconds averageTimerError{0};
+        std::chrono::microseconds maxTimerError{0};
+        std::chrono::nanoseconds cpuTime{0};
+        // Seconds in which the task went over its budget, with the tasks it owns; 0 for an owned task
+        uint64_t overBudgetPeriods = 0;
+    };
+
+    // Throws std::runtime_error if the epoll set cannot be created
+    RenderWorkerPool(std::size_t workers, std::chrono::milliseconds timerSlack, const RenderThreadSettings &threadSettings);
+    ~RenderWorkerPool();
+    RenderWorkerPool(const RenderWorkerPool &) = delete;
+    RenderWorkerPool &operator=(const RenderWorkerPool &) = delete;
+
+    // Starts running steps of the task, the first one right away
+    void add(RenderTask &task, const Policy &policy);
+    // Same, for a task that does part of the work of owner: its steps are charged to the policy,
+    // CPU budget and fair share of owner. Owner must be added before and removed after it.
+    void add(RenderTask &task, RenderTask &owner);
+    // Returns once the task is not running and will not run again until added anew
+    void remove(RenderTask &task);
+    // Runs the task soon if it sleeps, or again after its current step
+    void wake(RenderTask &task, Doorbell::Priority priority);
+    // Calls onReadable on a worker whenever fd is readable, one call at a time, until it returns false.
+    // onReadable should read what it can without blocking; false if fd cannot be watched.
+    bool addFd(int fd, std::function<bool()> onReadable);
+    // Returns once onReadable is not running and will not be called again
+    void removeFd(int fd);
+    std::size_t getWorkerCount() const;
+    // False once a worker could not be given all of the thread settings
+    bool areThreadSettingsApplied() const;
+    TaskStatistics getTaskStatistics(const RenderTask &task);
+    // Whether the calling thread is a worker of any pool, which must not wait for tasks to make progress
+    static bool isWorkerThread();
+private:
+    struct Timer {
+        RenderTask *task;
+        uint64_t generation;
+    };
+    struct Watch {
+        std::function<bool()> onReadable;
+        bool running = false;
+        bool removed = false;
+    };
+    using UniqueLock = std::unique_lock<std::mutex>;
+
+    void workerLoop(std::size_t index);
+    // Call with the lock held; runs the ready task that is next in line, or a watch, without it
+    void runTask(UniqueLock &lock);
+    // Call with mMutex acquired
+    std::deque<RenderTask *>::iterator pickReady(std::chrono::steady_clock::time_point now);
+    bool isOverBudget(const RenderTask &task, std::chrono::steady_clock::time_point now) const;
+    void runWatch(UniqueLock &lock, int fd);
+    // Call with mMutex acquired; resets the statistics of a removed task and makes it ready
+    void start(RenderTask &task, RenderTask &account);
+    // Call with mMutex acquired
+    void makeReady(RenderTask &task);
+    // Call with mMutex acquired; moves tasks whose timeout has passed to mReady
+    void fireTimers(std::chrono::steady_clock::time_point now);
+    // Call with mMutex acquired
+    void reschedule(RenderTask &task, std::chrono::milliseconds waitTime);
+    // Call with mMutex acquired; points mTimerFd at the earliest timer
+    void armTimer();
+    // Lets one idle worker out of epoll_wait
+    void signalWorker();
+
+    subttxrend::common::Logger mLogger;
+    const std::chrono::milliseconds mTimerSlack;
+    const RenderThreadSettings mThreadSettings;
+    std::atomic<bool> mThreadSettingsApplied{true};
+    int mEpollFd = -1;
+    int mWakeFd = -1;
+    int mTimerFd = -1;
+    std::mutex mMutex;
+    // For remove and removeFd, when a task or watch is done running
+    std::condition_variable mRunDoneCond;
+    // Protected by mMutex
+    std::deque<RenderTask *> mReady;
+    TimerWheel<Timer> mTimers;
+    std::map<int, std::unique_ptr<Watch>> mWatches;
+    std::chrono::steady_clock::time_point mArmedTime = std::chrono::steady_clock::time_point::max();
+    std::size_t mIdleWorkers = 0;
+    // The highest virtual time a task was picked with
+    std::chrono::nanoseconds mVirtualTime{0};
+    bool mStop = false;
+    std::vector<std::thread> mWorkers;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "SharedMemorySource.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <subttxrend/protocol/Packet.hpp>
+
+#if TEXTTRACK_WITH_CHOWN_DOBBYAPP
+#include <pwd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+// Packet header up to and including the size word; the size counts the bytes after it
+constexpr std::size_t PACKET_SIZE_END = 12;
+constexpr std::size_t DATA_OFFSET = 4096;
+constexpr std::size_t MIN_CAPACITY = 4096;
+
+// The ring is a data path only; controlling the session is left to the API
+bool isDataPacketType(uint32_t type) {
+    using subttxrend::protocol::Packet;
+    switch (static_cast<Packet::Type>(type)) {
+        case Packet::Type::PES_DATA:
+        case Packet::Type::TTML_DATA:
+        case Packet::Type::WEBVTT_DATA:
+        case Packet::Type::CC_DATA:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::size_t roundUpToPowerOfTwo(std::size_t value) {
+    std::size_t result = MIN_CAPACITY;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+SharedMemorySource::SharedMemorySource(std::string name, std::size_t capacity, DataBufferPool &pool)
+    : mLogger("App", "SharedMemorySource", this), mName(std::move(name)), mCapacity(roundUpToPowerOfTwo(capacity)), mPool(pool) {}
+
+SharedMemorySource::~SharedMemorySource() {
+    stop();
+}
+
+bool SharedMemorySource::open() {
+    if (mHeader) {
+        return true;
+    }
+    // A leftover from a crashed instance would otherwise make us fail
+    shm_unlink(mName.c_str());
+    // The name is predictable, so keep others out; the player gets in through the fchown below
+    const int fd = shm_open(mName.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd < 0) {
+        mLogger.oserror(__LOGGER_FUNC__, " - shm_open ", mName, " failed, errno=", errno);
+        return false;
+    }
+    mMappedSize = DATA_OFFSET + mCapacity;
+    if (ftruncate(fd, static_cast<off_t>(mMappedSize)) != 0) {
+        mLogger.oserror(__LOGGER_FUNC__, " - ftruncate failed, errno=", errno);
+        ::close(fd);
+        shm_unlink(mName.c_str());
+        return false;
+    }
+#if TEXTTRACK_WITH_CHOWN_DOBBYAPP
+    {
+        struct passwd user;
+        struct passwd *result{nullptr};
+        char extra_info[8192];
+        if (getpwnam_r("dobbyapp", &user, extra_info, sizeof(extra_info), &result) == 0 && result != nullptr) {
+            if (fchown(fd, user.pw_uid, user.pw_gid) != 0) {
+                mLogger.oserror(__LOGGER_FUNC__, " - chown failed, errno=", errno);
+            }
+        } else {
+            mLogger.oserror(__LOGGER_FUNC__, " - Unable to lookup uid of dobbyapp");
+        }
+    }
+#endif
+    void *const mapping = mmap(nullptr, mMappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mLogger.oserror(__LOGGER_FUNC__, " - mmap failed, errno=", errno);
+        shm_unlink(mName.c_str());
+        return false;
+    }
+    // ftruncate gave us zeroed memory, so only the fixed fields need filling in
+    mHeader = new (mapping) SharedMemoryRingHeader;
+    mHeader->capacity = static_cast<uint32_t>(mCapacity);
+    mHeader->dataOffset = static_cast<uint32_t>(DATA_OFFSET);
+    mHeader->version = SharedMemoryRingHeader::VERSION;
+    // Written last; the player must not touch the ring before it sees it
+    std::atomic_thread_fence(std::memory_order_release);
+    mHeader->magic = SharedMemoryRingHeader::MAGIC;
+    mData = static_cast<const char *>(mapping) + DATA_OFFSET;
+    mLogger.osinfo(__LOGGER_FUNC__, " - opened ", mName, " with ", mCapacity, " bytes");
+    return true;
+}
+
+const std::string &SharedMemorySource::getName() const {
+    return mName;
+}
+
+void SharedMemorySource::start(subttxrend::socksrc::PacketReceiver *receiver) {
+    if (!mHeader || mThread.joinable()) {
+        return;
+    }
+    mQuit = false;
+    mThread = std::thread(&SharedMemorySource::readLoop, this, receiver);
+}
+
+void SharedMemorySource::stop() {
+    if (!mHeader) {
+        return;
+    }
+    mQuit = true;
+    mHeader->doorbell.fetch_add(1);
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&mHeader->doorbell), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    munmap(mHeader, mMappedSize);
+    shm_unlink(mName.c_str());
+    mHeader = nullptr;
+    mData = nullptr;
+}
+
+void SharedMemorySource::readLoop(subttxrend::socksrc::PacketReceiver *receiver) {
+    while (!mQuit) {
+        const uint64_t readPosition = mHeader->readPosition.load(std::memory_order_relaxed);
+        const uint64_t available = mHeader->writePosition.load(std::memory_order_acquire) - readPosition;
+        if (available == 0) {
+            waitForData();
+            continue;
+        }
+        uint32_t size = 0;
+        if (available >= PACKET_SIZE_END) {
+            copyOut(readPosition + PACKET_SIZE_END - sizeof(size), reinterpret_cast<char *>(&size), sizeof(size));
+        }
+        const uint64_t packetSize = PACKET_SIZE_END + static_cast<uint64_t>(size);
+        if (available < PACKET_SIZE_END || available > mCapacity || packetSize > available) {
+            // The writer only publishes whole packets, so the ring is corrupt; skip what is there
+            mLogger.oserror(__LOGGER_FUNC__, " - bad ring content, dropping ", available, " bytes");
+            mHeader->readPosition.store(readPosition + available, std::memory_order_release);
+            continue;
+        }
+        auto buffer = mPool.acquire(packetSize);
+        buffer->resize(packetSize);
+        copyOut(readPosition, buffer->data(), packetSize);
+        // The writer may reuse the room as soon as it sees this
+        mHeader->readPosition.store(readPosition + packetSize, std::memory_order_release);
+        // Checked on our copy, the writer can still change the ring
+        uint32_t type = 0;
+        std::memcpy(&type, buffer->data(), sizeof(type));
+        if (!isDataPacketType(type)) {
+            mLogger.oserror(__LOGGER_FUNC__, " - dropping packet of type ", type, ", only data is accepted");
+            mPool.release(std::move(buffer));
+            continue;
+        }
+        receiver->addBuffer(std::move(buffer));
+    }
+}
+
+void SharedMemorySource::copyOut(uint64_t position, char *dest, std::size_t size) const {
+    const std::size_t offset = position & (mCapacity - 1);
+    const std::size_t first = std::min(size, mCapacity - offset);
+    std::memcpy(dest, mData + offset, first);
+    std::memcpy(dest + first, mData, size - first);
+}
+
+void SharedMemorySource::waitForData() {
+    const uint32_t doorbell = mHeader->doorbell.load();
+    mHeader->readerWaiting = 1;
+    // Check again now that the writer will wake us, unless we are stopped in between
+    if (!mQuit && mHeader->writePosition.load() == mHeader->readPosition.load(std::memory_order_relaxed)) {
+        // Wake up now and then anyway, in case the writer does not ring
+        const struct timespec timeout { 0, 100 * 1000 * 1000 };
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&mHeader->doorbell), FUTEX_WAIT, doorbell, &timeout, nullptr, 0);
+    }
+    mHeader->readerWaiting = 0;
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
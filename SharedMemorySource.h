@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <subttxrend/common/Logger.hpp>
+#include <subttxrend/socksrc/PacketReceiver.hpp>
+#include <thread>
+
+#include "DataBufferPool.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Start of the shared memory of a SharedMemorySource; the ring follows at dataOffset.
+//
+// The writer appends whole data packets in the socket format (type, counter, size, channel id, payload)
+// at writePosition % capacity, wrapping around the end of the ring, and never past
+// readPosition + capacity. It then publishes them by storing the new writePosition, increments
+// doorbell and, if readerWaiting is set, wakes the reader with FUTEX_WAKE on doorbell.
+// Positions only ever grow. Packets of any other than the PES, TTML, WebVTT and CC data types are
+// skipped; the session is controlled through the API only.
+struct SharedMemoryRingHeader {
+    static constexpr uint32_t MAGIC = 0x54545352;
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    // Size of the ring in bytes, a power of two
+    uint32_t capacity;
+    uint32_t dataOffset;
+    // Written by the player only
+    alignas(64) std::atomic<uint64_t> writePosition;
+    // Written by the reader only
+    alignas(64) std::atomic<uint64_t> readPosition;
+    alignas(64) std::atomic<uint32_t> doorbell;
+    std::atomic<uint32_t> readerWaiting;
+};
+
+// Packet source that reads from a ring in named shared memory, so a player can hand over
+// packets without a socket or JSON-RPC in between. Each packet is copied out once, into
+// a buffer from the pool, and passed to PacketReceiver::addBuffer. The shared memory is only
+// accessible to our user and group, which is dobbyapp's with TEXTTRACK_WITH_CHOWN_DOBBYAPP.
+class SharedMemorySource {
+public:
+    // name as for shm_open, e.g. "/texttrack-1"
+    SharedMemorySource(std::string name, std::size_t capacity, DataBufferPool &pool);
+    ~SharedMemorySource();
+    SharedMemorySource(const SharedMemorySource &) = delete;
+    SharedMemorySource &operator=(const SharedMemorySource &) = delete;
+
+    // Creates and maps the shared memory; false if that failed
+    bool open();
+    const std::string &getName() const;
+    void start(subttxrend::socksrc::PacketReceiver *receiver);
+    // Stops reading and removes the shared memory
+    void stop();
+private:
+    void readLoop(subttxrend::socksrc::PacketReceiver *receiver);
+    // Copies size bytes at ring position into dest
+    void copyOut(uint64_t position, char *dest, std::size_t size) const;
+    // Blocks until the writer rings the doorbell or we are stopped
+    void waitForData();
+
+    subttxrend::common::Logger mLogger;
+    const std::string mName;
+    std::size_t mCapacity;
+    DataBufferPool &mPool;
+    SharedMemoryRingHeader *mHeader = nullptr;
+    const char *mData = nullptr;
+    std::size_t mMappedSize = 0;
+    std::atomic<bool> mQuit{false};
+    std::thread mThread;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,520 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "SidecarFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+namespace WPEFramework {
+namespace Plugin {
+
+namespace {
+
+constexpr uint64_t FOREVER = std::numeric_limits<uint64_t>::max();
+// Far more than the subtitles of a feature film; indexing anything bigger would hold up the caller too long
+constexpr off_t MAX_FILE_SIZE = 16 * 1024 * 1024;
+
+// The path with all symlinks and dot components resolved, or empty if it does not lie within directory
+std::string resolveWithin(const std::string &directory, const std::string &path) {
+    char *const resolvedDirectory = realpath(directory.c_str(), nullptr);
+    if (!resolvedDirectory) {
+        return {};
+    }
+    std::string prefix(resolvedDirectory);
+    free(resolvedDirectory);
+    if (prefix.back() != '/') {
+        prefix += '/';
+    }
+    char *const resolvedPath = realpath(path.c_str(), nullptr);
+    if (!resolvedPath) {
+        return {};
+    }
+    std::string result(resolvedPath);
+    free(resolvedPath);
+    if (result.compare(0, prefix.size(), prefix) != 0) {
+        return {};
+    }
+    return result;
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Reads digits at pos; false if there are none
+bool parseNumber(std::string_view text, std::size_t &pos, uint64_t &value) {
+    const std::size_t start = pos;
+    value = 0;
+    while (pos < text.size() && isDigit(text[pos])) {
+        value = value * 10 + (text[pos++] - '0');
+    }
+    return pos != start;
+}
+
+// Reads "." followed by digits as milliseconds; nothing if there is no "."
+uint64_t parseFractionMs(std::string_view text, std::size_t &pos) {
+    uint64_t ms = 0;
+    if (pos < text.size() && text[pos] == '.') {
+        ++pos;
+        uint64_t scale = 100;
+        while (pos < text.size() && isDigit(text[pos])) {
+            ms += (text[pos++] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    return ms;
+}
+
+// WebVTT timestamp: [hh:]mm:ss.ttt
+bool parseWebvttTime(std::string_view text, std::size_t &pos, uint64_t &ms) {
+    uint64_t parts[3] = {};
+    int count = 0;
+    while (count != 3) {
+        if (!parseNumber(text, pos, parts[count++])) {
+            return false;
+        }
+        if (pos == text.size() || text[pos] != ':') {
+            break;
+        }
+        ++pos;
+    }
+    if (count < 2) {
+        return false;
+    }
+    const uint64_t hours = count == 3 ? parts[0] : 0;
+    const uint64_t minutes = parts[count - 2];
+    const uint64_t seconds = parts[count - 1];
+    ms = ((hours * 60 + minutes) * 60 + seconds) * 1000 + parseFractionMs(text, pos);
+    return true;
+}
+
+// TTML time expression: clock time hh:mm:ss[.fff] or hh:mm:ss:ff, or offset time <n>[.n](h|m|s|ms|f|t)
+bool parseTtmlTime(std::string_view text, double frameRate, double tickRate, uint64_t &ms) {
+    std::size_t pos = 0;
+    while (pos < text.size() && isSpace(text[pos])) {
+        ++pos;
+    }
+    uint64_t first = 0;
+    if (!parseNumber(text, pos, first)) {
+        return false;
+    }
+    if (pos < text.size() && text[pos] == ':') {
+        uint64_t minutes = 0;
+        uint64_t seconds = 0;
+        ++pos;
+        if (!parseNumber(text, pos, minutes) || pos == text.size() || text[pos++] != ':' || !parseNumber(text, pos, seconds)) {
+            return false;
+        }
+        ms = ((first * 60 + minutes) * 60 + seconds) * 1000;
+        if (pos < text.size() && text[pos] == ':') {
+            uint64_t frames = 0;
+            ++pos;
+            if (!parseNumber(text, pos, frames)) {
+                return false;
+            }
+            ms += static_cast<uint64_t>(frames * 1000 / frameRate);
+        } else {
+            ms += parseFractionMs(text, pos);
+        }
+        return true;
+    }
+    double value = static_cast<double>(first);
+    if (pos < text.size() && text[pos] == '.') {
+        ++pos;
+        double scale = 0.1;
+        while (pos < text.size() && isDigit(text[pos])) {
+            value += (text[pos++] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    const std::string_view metric = text.substr(pos, text.find_first_of(" \t\r\n", pos) - pos);
+    double seconds = 0;
+    if (metric == "h") {
+        seconds = value * 3600;
+    } else if (metric == "m") {
+        seconds = value * 60;
+    } else if (metric == "s") {
+        seconds = value;
+    } else if (metric == "ms") {
+        seconds = value / 1000;
+    } else if (metric == "f") {
+        seconds = value / frameRate;
+    } else if (metric == "t") {
+        seconds = value / tickRate;
+    } else {
+        return false;
+    }
+    ms = static_cast<uint64_t>(seconds * 1000 + 0.5);
+    return true;
+}
+
+// Value of attribute name (with or without a namespace prefix) in a start tag
+bool findAttribute(std::string_view tag, std::string_view name, std::string_view &value) {
+    for (std::size_t pos = tag.find(name); pos != std::string_view::npos; pos = tag.find(name, pos + 1)) {
+        const char before = pos != 0 ? tag[pos - 1] : '<';
+        std::size_t after = pos + name.size();
+        if (!(isSpace(before) || before == ':')) {
+            continue;
+        }
+        while (after < tag.size() && isSpace(tag[after])) {
+            ++after;
+        }
+        if (after >= tag.size() || tag[after] != '=') {
+            continue;
+        }
+        ++after;
+        while (after < tag.size() && isSpace(tag[after])) {
+            ++after;
+        }
+        if (after >= tag.size() || (tag[after] != '"' && tag[after] != '\'')) {
+            continue;
+        }
+        const std::size_t end = tag.find(tag[after], after + 1);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        value = tag.substr(after + 1, end - after - 1);
+        return true;
+    }
+    return false;
+}
+
+// End of the tag that starts at pos, just past its '>', or npos
+std::size_t findTagEnd(std::string_view text, std::size_t pos) {
+    char quote = 0;
+    for (; pos < text.size(); ++pos) {
+        const char c = text[pos];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            return pos + 1;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Whether text holds nothing but white space and comments
+bool isBlank(std::string_view text) {
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        if (isSpace(text[pos])) {
+            ++pos;
+        } else if (text.compare(pos, 4, "<!--") == 0) {
+            const std::size_t commentEnd = text.find("-->", pos);
+            if (commentEnd == std::string_view::npos) {
+                return false;
+            }
+            pos = commentEnd + 3;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+SidecarFile::SidecarFile(std::string path) : mPath(std::move(path)) {}
+
+SidecarFile::~SidecarFile() {
+    if (mData) {
+        munmap(const_cast<char *>(mData), mSize);
+    }
+}
+
+bool SidecarFile::open(const std::string &directory) {
+    const std::string path = resolveWithin(directory, mPath);
+    if (path.empty()) {
+        return false;
+    }
+    // Clients choose the path: don't block on a FIFO or device, and only take regular files
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOFOLLOW);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0 || info.st_size > MAX_FILE_SIZE) {
+        ::close(fd);
+        return false;
+    }
+    mSize = static_cast<std::size_t>(info.st_size);
+    void *const mapping = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    mData = static_cast<const char *>(mapping);
+    madvise(mapping, mSize, MADV_SEQUENTIAL);
+
+    std::string_view text(mData, mSize);
+    // UTF-8 BOM
+    const std::size_t start = text.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0;
+    if (text.compare(start, 6, "WEBVTT") == 0) {
+        mFormat = Format::WEBVTT;
+        return indexWebvtt();
+    }
+    if (text.find("<tt") != std::string_view::npos) {
+        mFormat = Format::TTML;
+        return indexTtml();
+    }
+    return false;
+}
+
+SidecarFile::Format SidecarFile::getFormat() const {
+    return mFormat;
+}
+
+const std::string &SidecarFile::getPath() const {
+    return mPath;
+}
+
+bool SidecarFile::indexWebvtt() {
+    const std::string_view text(mData, mSize);
+    std::size_t pos = 0;
+    mHeaderEnd = mSize;
+    mTrailerBegin = mSize;
+    while (pos < text.size()) {
+        // Skip blank lines, then take lines up to the next blank one as a block
+        while (pos < text.size() && (text[pos] == '\n' || text[pos] == '\r')) {
+            ++pos;
+        }
+        const std::size_t blockStart = pos;
+        std::size_t timingLine = std::string_view::npos;
+        int lines = 0;
+        while (pos < text.size()) {
+            std::size_t lineEnd = text.find('\n', pos);
+            if (lineEnd == std::string_view::npos) {
+                lineEnd = text.size();
+            }
+            const std::string_view line = text.substr(pos, lineEnd - pos);
+            if (line.empty() || line == "\r") {
+                break;
+            }
+            // The timing line is the first or second line of a cue
+            if (lines < 2 && timingLine == std::string_view::npos && line.find("-->") != std::string_view::npos) {
+                timingLine = pos;
+            }
+            ++lines;
+            pos = std::min(lineEnd + 1, text.size());
+        }
+        std::size_t blockEnd = pos;
+        while (blockEnd > blockStart && (text[blockEnd - 1] == '\n' || text[blockEnd - 1] == '\r')) {
+            --blockEnd;
+        }
+        if (blockEnd == blockStart || timingLine == std::string_view::npos) {
+            // Header blocks before the first cue are kept, NOTE blocks between cues are not needed
+            continue;
+        }
+        std::size_t timePos = timingLine;
+        Cue cue{};
+        if (!parseWebvttTime(text, timePos, cue.beginMs)) {
+            continue;
+        }
+        timePos = text.find("-->", timePos);
+        timePos += 3;
+        while (timePos < text.size() && (text[timePos] == ' ' || text[timePos] == '\t')) {
+            ++timePos;
+        }
+        if (!parseWebvttTime(text, timePos, cue.endMs)) {
+            continue;
+        }
+        if (mCues.empty()) {
+            mHeaderEnd = blockStart;
+        }
+        cue.offset = static_cast<uint32_t>(blockStart);
+        cue.length = static_cast<uint32_t>(blockEnd - blockStart);
+        mCues.push_back(cue);
+    }
+    // Cues must be in order of start time, but don't rely on it
+    mCuesInFileOrder = std::is_sorted(mCues.begin(), mCues.end(), [](const Cue &a, const Cue &b) { return a.beginMs < b.beginMs; });
+    std::stable_sort(mCues.begin(), mCues.end(), [](const Cue &a, const Cue &b) { return a.beginMs < b.beginMs; });
+    return true;
+}
+
+bool SidecarFile::indexTtml() {
+    const std::string_view text(mData, mSize);
+    // Hand out the whole document as a single cue when we cannot split it
+    const auto useWholeDocument = [this]() {
+        mCues.assign(1, Cue{0, FOREVER, 0, static_cast<uint32_t>(mSize)});
+        mHeaderEnd = 0;
+        mTrailerBegin = mSize;
+        mCuesInFileOrder = true;
+        return true;
+    };
+
+    double frameRate = 30;
+    double tickRate = 1;
+    std::size_t previousEnd = std::string_view::npos;
+    for (std::size_t pos = text.find('<'); pos != std::string_view::npos; pos = text.find('<', pos)) {
+        if (text.compare(pos, 4, "<!--") == 0) {
+            const std::size_t commentEnd = text.find("-->", pos);
+            if (commentEnd == std::string_view::npos) {
+                break;
+            }
+            pos = commentEnd + 3;
+            continue;
+        }
+        const std::size_t tagEnd = findTagEnd(text, pos);
+        if (tagEnd == std::string_view::npos) {
+            return useWholeDocument();
+        }
+        const std::string_view tag = text.substr(pos, tagEnd - pos);
+        std::size_t nameEnd = 1;
+        while (nameEnd < tag.size() && !isSpace(tag[nameEnd]) && tag[nameEnd] != '>' && tag[nameEnd] != '/') {
+            ++nameEnd;
+        }
+        const std::string_view name = tag.substr(1, nameEnd - 1);
+        const std::size_t colon = name.find(':');
+        const std::string_view localName = colon == std::string_view::npos ? name : name.substr(colon + 1);
+        std::string_view value;
+        if (localName == "tt") {
+            if (findAttribute(tag, "timeBase", value) && value != "media") {
+                return useWholeDocument();
+            }
+            if (findAttribute(tag, "frameRate", value)) {
+                frameRate = std::max(1.0, std::atof(std::string(value).c_str()));
+            }
+            if (findAttribute(tag, "tickRate", value)) {
+                tickRate = std::max(1.0, std::atof(std::string(value).c_str()));
+            }
+        }
+        if (localName != "p") {
+            // Timing on anything that contains the paragraphs would shift them
+            if ((localName == "body" || localName == "div") && findAttribute(tag, "begin", value)) {
+                return useWholeDocument();
+            }
+            pos = tagEnd;
+            continue;
+        }
+        std::size_t elementEnd = tagEnd;
+        if (tag[tag.size() - 2] != '/') {
+            const std::string closing = "</" + std::string(name) + ">";
+            elementEnd = text.find(closing, tagEnd);
+            if (elementEnd == std::string_view::npos) {
+                return useWholeDocument();
+            }
+            elementEnd += closing.size();
+        }
+        // Splitting is only safe if the paragraphs are siblings with nothing else in between
+        if (previousEnd != std::string_view::npos && !isBlank(text.substr(previousEnd, pos - previousEnd))) {
+            return useWholeDocument();
+        }
+        Cue cue{0, FOREVER, static_cast<uint32_t>(pos), static_cast<uint32_t>(elementEnd - pos)};
+        if (findAttribute(tag, "begin", value) && !parseTtmlTime(value, frameRate, tickRate, cue.beginMs)) {
+            return useWholeDocument();
+        }
+        if (findAttribute(tag, "end", value)) {
+            if (!parseTtmlTime(value, frameRate, tickRate, cue.endMs)) {
+                return useWholeDocument();
+            }
+        } else if (findAttribute(tag, "dur", value)) {
+            uint64_t duration = 0;
+            if (!parseTtmlTime(value, frameRate, tickRate, duration)) {
+                return useWholeDocument();
+            }
+            cue.endMs = cue.beginMs + duration;
+        }
+        if (mCues.empty()) {
+            mHeaderEnd = pos;
+        }
+        mCues.push_back(cue);
+        previousEnd = elementEnd;
+        pos = elementEnd;
+    }
+    if (mCues.empty()) {
+        return useWholeDocument();
+    }
+    mTrailerBegin = previousEnd;
+    mCuesInFileOrder = std::is_sorted(mCues.begin(), mCues.end(), [](const Cue &a, const Cue &b) { return a.beginMs < b.beginMs; });
+    std::stable_sort(mCues.begin(), mCues.end(), [](const Cue &a, const Cue &b) { return a.beginMs < b.beginMs; });
+    return true;
+}
+
+bool SidecarFile::seek(uint64_t timeMs) {
+    const std::size_t previous = mNextCue;
+    mNextCue = mCues.size();
+    for (std::size_t i = 0; i != mCues.size(); ++i) {
+        if (mCues[i].endMs > timeMs) {
+            mNextCue = i;
+            break;
+        }
+    }
+    return mNextCue < previous;
+}
+
+bool SidecarFile::takeCues(uint64_t untilMs, subttxrend::common::DataBuffer &output) {
+    std::size_t end = mNextCue;
+    std::size_t size = mHeaderEnd + (mSize - mTrailerBegin);
+    while (end != mCues.size() && mCues[end].beginMs < untilMs) {
+        size += mCues[end++].length + 2;
+    }
+    if (end == mNextCue) {
+        return false;
+    }
+    output.reserve(output.size() + size);
+    output.insert(output.end(), mData, mData + mHeaderEnd);
+    for (std::size_t i = mNextCue; i != end; ++i) {
+        output.insert(output.end(), mData + mCues[i].offset, mData + mCues[i].offset + mCues[i].length);
+        if (mFormat == Format::WEBVTT) {
+            // Cues are separated by a blank line
+            output.push_back('\n');
+            output.push_back('\n');
+        }
+    }
+    output.insert(output.end(), mData + mTrailerBegin, mData + mSize);
+    mNextCue = end;
+    releaseConsumed();
+    return true;
+}
+
+void SidecarFile::releaseConsumed() {
+    if (!mCuesInFileOrder) {
+        return;
+    }
+    const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    // The header is needed for every piece, the rest only until its cues are handed out
+    const std::size_t start = std::max(mReleasedEnd, (mHeaderEnd + pageSize - 1) / pageSize * pageSize);
+    const std::size_t target = mNextCue != mCues.size() ? mCues[mNextCue].offset : mTrailerBegin;
+    const std::size_t end = target / pageSize * pageSize;
+    if (end > start) {
+        madvise(const_cast<char *>(mData) + start, end - start, MADV_DONTNEED);
+        mReleasedEnd = end;
+    }
+}
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <subttxrend/common/DataBuffer.hpp>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// A complete WebVTT or TTML subtitle file, mapped into memory and indexed by cue time,
+// so that it can be handed to a controller a few cues at a time instead of all at once.
+//
+// Each piece is a small document of its own: the header of the file (WebVTT header
+// blocks, or the TTML markup up to the first <p>) followed by the cues and, for TTML,
+// the markup after the last <p>. A TTML file that does not keep all <p> elements
+// side by side in one parent, or whose timing we cannot read, is handed out whole.
+class SidecarFile {
+public:
+    enum class Format {
+        WEBVTT,
+        TTML
+    };
+
+    explicit SidecarFile(std::string path);
+    ~SidecarFile();
+    SidecarFile(const SidecarFile &) = delete;
+    SidecarFile &operator=(const SidecarFile &) = delete;
+
+    // Maps the file and builds the index; false if the file cannot be used. The file must be
+    // a regular file of at most 16 MiB within directory, after following symlinks.
+    bool open(const std::string &directory);
+    Format getFormat() const;
+    const std::string &getPath() const;
+    // Moves to the first cue that is still showing or to come at timeMs. Returns true if that
+    // goes back to cues that were handed out already, which takeCues will then hand out again.
+    bool seek(uint64_t timeMs);
+    // Appends a document with all cues not handed out yet that begin before untilMs; false if there are none
+    bool takeCues(uint64_t untilMs, subttxrend::common::DataBuffer &output);
+private:
+    struct Cue {
+        uint64_t beginMs;
+        uint64_t endMs;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    bool indexWebvtt();
+    bool indexTtml();
+    // Lets the kernel take back the pages of cues we are done with
+    void releaseConsumed();
+
+    std::string mPath;
+    Format mFormat = Format::WEBVTT;
+    const char *mData = nullptr;
+    std::size_t mSize = 0;
+    // Document parts that go around every piece
+    std::size_t mHeaderEnd = 0;
+    std::size_t mTrailerBegin = 0;
+    // Sorted by beginMs
+    std::vector<Cue> mCues;
+    // Whether mCues is also in file order, so everything before the next cue is done with
+    bool mCuesInFileOrder = true;
+    std::size_t mNextCue = 0;
+    std::size_t mReleasedEnd = 0;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
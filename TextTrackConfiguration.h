@@ -31,6 +31,21 @@ public:
         Add(_T("standdarddisplay"), &StandardDisplay);
         Add(_T("standardsocket"), &StandardSocket);
         Add(_T("persistentstore"), &PersistentStore);
+        Add(_T("dataqueuecapacity"), &DataQueueCapacity);
+        Add(_T("dataqueueoverflow"), &DataQueueOverflow);
+        Add(_T("sharedmemorysize"), &SharedMemorySize);
+        Add(_T("maxdatalatency"), &MaxDataLatency);
+        Add(_T("batchedsocket"), &BatchedSocket);
+        Add(_T("ccprefilter"), &CcPreFilter);
+        Add(_T("renderworkers"), &RenderWorkers);
+        Add(_T("timerslack"), &TimerSlack);
+        Add(_T("sessioncpubudget"), &SessionCpuBudget);
+        Add(_T("renderpolicy"), &RenderPolicy);
+        Add(_T("renderpriority"), &RenderPriority);
+        Add(_T("rendernice"), &RenderNice);
+        Add(_T("renderaffinity"), &RenderAffinity);
+        Add(_T("pipelinedrendering"), &PipelinedRendering);
+        Add(_T("sidecardirectory"), &SidecarDirectory);
     }
     ~TextTrackConfiguration() = default;
     TextTrackConfiguration(const TextTrackConfiguration &) = delete;
@@ -39,4 +54,37 @@ public:
     WPEFramework::Core::JSON::String StandardDisplay;
     WPEFramework::Core::JSON::String StandardSocket;
     WPEFramework::Core::JSON::String PersistentStore;
+    // Maximum number of data packets queued per session
+    WPEFramework::Core::JSON::DecUInt32 DataQueueCapacity;
+    // "block", "dropoldest" or "reject". Data that is refused makes SendSessionData return ERROR_UNAVAILABLE.
+    // Sockets read by render workers drop the oldest instead of blocking.
+    WPEFramework::Core::JSON::String DataQueueOverflow;
+    // Size in bytes of the shared memory ring of a session
+    WPEFramework::Core::JSON::DecUInt32 SharedMemorySize;
+    // Milliseconds after which a session that falls behind skips queued data as expired, as far as later data
+    // does not build on it, 0 to never skip
+    WPEFramework::Core::JSON::DecUInt32 MaxDataLatency;
+    // Read session sockets with recvmmsg, many packets per system call
+    WPEFramework::Core::JSON::Boolean BatchedSocket;
+    // Strip CEA-608 padding and redundant control codes before CC data is queued
+    WPEFramework::Core::JSON::Boolean CcPreFilter;
+    // Threads shared by all sessions for rendering and batched sockets, at most one per core; 0 to give every session its own
+    WPEFramework::Core::JSON::DecUInt32 RenderWorkers;
+    // Milliseconds by which render workers may delay a timeout, to serve those due close together with one wake up
+    WPEFramework::Core::JSON::DecUInt32 TimerSlack;
+    // Milliseconds of render worker time per second a session other than the standard one can use
+    // before the others go first, 0 for no limit. Ignored without RenderWorkers.
+    WPEFramework::Core::JSON::DecUInt32 SessionCpuBudget;
+    // Scheduling of render threads and workers: "other", "fifo" or "rr", empty to leave it as it is
+    WPEFramework::Core::JSON::String RenderPolicy;
+    // Real-time priority with "fifo" or "rr"
+    WPEFramework::Core::JSON::DecUInt32 RenderPriority;
+    // Nice value otherwise, 0 to leave it as it is
+    WPEFramework::Core::JSON::DecSInt32 RenderNice;
+    // Bit per CPU that render threads may run on, 0 for any
+    WPEFramework::Core::JSON::DecUInt64 RenderAffinity;
+    // Present frames on a thread of their own, so that decoding the next cue overlaps with showing the current one
+    WPEFramework::Core::JSON::Boolean PipelinedRendering;
+    // Directory that sidecar files must be in, empty to refuse all sidecar files
+    WPEFramework::Core::JSON::String SidecarDirectory;
 };
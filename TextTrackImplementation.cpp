@@ -27,7 +27,7 @@
 #include <subttxrend/cc/CcCommand.hpp>
 #include <subttxrend/common/LoggerManager.hpp>
 
-#include "RenderSession.h"
+#include "Base64.h"
 
 #if TEXTTRACK_WITH_RDKSHELL
 // Assuming that use of RDKShell is only on devices with Thunder security enabled
@@ -106,6 +106,139 @@ public:
     Core::JSON::DecSInt8 windowOpacity = -1;
 };
 
+#if ITEXTTRACK_VERSION >= 4
+class JsonSessionStatistics : public Core::JSON::Container {
+    JsonSessionStatistics(const JsonSessionStatistics &) = delete;
+    JsonSessionStatistics &operator=(const JsonSessionStatistics &) = delete;
+public:
+    JsonSessionStatistics() : Core::JSON::Container() {
+        Add(_T("droppedPackets"), &droppedPackets);
+        Add(_T("expiredPackets"), &expiredPackets);
+        Add(_T("wakeupsPerSecond"), &wakeupsPerSecond);
+        Add(_T("socketReconnects"), &socketReconnects);
+        Add(_T("ccFilterInputBytes"), &ccFilterInputBytes);
+        Add(_T("ccFilterOutputBytes"), &ccFilterOutputBytes);
+        Add(_T("otherChannelPackets"), &otherChannelPackets);
+        Add(_T("incompletePesPackets"), &incompletePesPackets);
+        Add(_T("averageTimerErrorUs"), &averageTimerErrorUs);
+        Add(_T("maxTimerErrorUs"), &maxTimerErrorUs);
+        Add(_T("renderCpuTimeUs"), &renderCpuTimeUs);
+        Add(_T("overBudgetSeconds"), &overBudgetSeconds);
+        Add(_T("renderThreadSettingsApplied"), &renderThreadSettingsApplied);
+        Add(_T("coalescedFrames"), &coalescedFrames);
+    }
+    ~JsonSessionStatistics() = default;
+
+    JsonSessionStatistics &operator=(const RenderSessionStatistics &statistics) {
+        droppedPackets = statistics.droppedPackets;
+        expiredPackets = statistics.expiredPackets;
+        wakeupsPerSecond = statistics.wakeupsPerSecond;
+        socketReconnects = statistics.socketReconnects;
+        ccFilterInputBytes = statistics.ccFilterInputBytes;
+        ccFilterOutputBytes = statistics.ccFilterOutputBytes;
+        otherChannelPackets = statistics.otherChannelPackets;
+        incompletePesPackets = statistics.incompletePesPackets;
+        averageTimerErrorUs = statistics.averageTimerErrorUs;
+        maxTimerErrorUs = statistics.maxTimerErrorUs;
+        renderCpuTimeUs = statistics.renderCpuTimeUs;
+        overBudgetSeconds = statistics.overBudgetSeconds;
+        renderThreadSettingsApplied = statistics.renderThreadSettingsApplied;
+        coalescedFrames = statistics.coalescedFrames;
+        return *this;
+    }
+
+    Core::JSON::DecUInt64 droppedPackets = 0;
+    Core::JSON::DecUInt64 expiredPackets = 0;
+    Core::JSON::DecUInt32 wakeupsPerSecond = 0;
+    Core::JSON::DecUInt64 socketReconnects = 0;
+    Core::JSON::DecUInt64 ccFilterInputBytes = 0;
+    Core::JSON::DecUInt64 ccFilterOutputBytes = 0;
+    Core::JSON::DecUInt64 otherChannelPackets = 0;
+    Core::JSON::DecUInt64 incompletePesPackets = 0;
+    Core::JSON::DecUInt32 averageTimerErrorUs = 0;
+    Core::JSON::DecUInt32 maxTimerErrorUs = 0;
+    Core::JSON::DecUInt64 renderCpuTimeUs = 0;
+    Core::JSON::DecUInt64 overBudgetSeconds = 0;
+    Core::JSON::Boolean renderThreadSettingsApplied = true;
+    Core::JSON::DecUInt64 coalescedFrames = 0;
+};
+#endif
+
+RenderSession::DataType convertDataType(Exchange::ITextTrack::DataType type) {
+    switch (type) {
+        case Exchange::ITextTrack::DataType::PES:
+#if ITEXTTRACK_VERSION >= 4
+        case Exchange::ITextTrack::DataType::PES_BASE64:
+#endif
+            return RenderSession::DataType::PES;
+        case Exchange::ITextTrack::DataType::TTML:
+#if ITEXTTRACK_VERSION >= 4
+        case Exchange::ITextTrack::DataType::TTML_ZLIB:
+        case Exchange::ITextTrack::DataType::TTML_ZSTD:
+#endif
+            return RenderSession::DataType::TTML;
+        case Exchange::ITextTrack::DataType::CC:
+            return RenderSession::DataType::CC;
+        case Exchange::ITextTrack::DataType::WEBVTT:
+#if ITEXTTRACK_VERSION >= 4
+        case Exchange::ITextTrack::DataType::WEBVTT_ZLIB:
+        case Exchange::ITextTrack::DataType::WEBVTT_ZSTD:
+#endif
+            return RenderSession::DataType::WEBVTT;
+    }
+    return RenderSession::DataType::CC; // Compiler says we need to return something
+}
+
+Compression convertCompression(Exchange::ITextTrack::DataType type) {
+    switch (type) {
+#if ITEXTTRACK_VERSION >= 4
+        case Exchange::ITextTrack::DataType::TTML_ZLIB:
+        case Exchange::ITextTrack::DataType::WEBVTT_ZLIB:
+            return Compression::ZLIB;
+        case Exchange::ITextTrack::DataType::TTML_ZSTD:
+        case Exchange::ITextTrack::DataType::WEBVTT_ZSTD:
+            return Compression::ZSTD;
+#endif
+        default:
+            return Compression::NONE;
+    }
+}
+
+Core::hresult convertSendResult(SendResult result) {
+    switch (result) {
+        case SendResult::ACCEPTED:
+            return Core::ERROR_NONE;
+        case SendResult::QUEUE_FULL:
+            // Worth trying again once the session has caught up
+            return Core::ERROR_UNAVAILABLE;
+        case SendResult::BAD_DATA:
+            break;
+    }
+    return Core::ERROR_GENERAL;
+}
+
+// Returns a packet buffer of session with the payload in place, or nullptr if the payload is malformed.
+// Compressed payloads stay compressed; the session decompresses them on its render thread.
+subttxrend::common::DataBufferPtr createDataBuffer(RenderSession &session, Exchange::ITextTrack::DataType type, const string &data) {
+#if ITEXTTRACK_VERSION >= 4
+    // Binary payloads are base64 encoded so they survive JSON-RPC
+    if (type == Exchange::ITextTrack::DataType::PES_BASE64 || convertCompression(type) != Compression::NONE) {
+        std::size_t size = 0;
+        if (!getBase64DecodedSize(data.data(), data.size(), size)) {
+            return nullptr;
+        }
+        auto buffer = session.createDataBuffer(convertDataType(type), size);
+        if (!decodeBase64(data.data(), data.size(), *buffer)) {
+            return nullptr;
+        }
+        return buffer;
+    }
+#endif
+    auto buffer = session.createDataBuffer(convertDataType(type), data.size());
+    buffer->insert(buffer->end(), data.begin(), data.end());
+    return buffer;
+}
+
 SubttxClosedCaptionsStyle convertClosedCaptionsStyle(const Exchange::ITextTrackClosedCaptionsStyle::ClosedCaptionsStyle &style) {
     constexpr const uint32_t CONTENT_DEFAULT = -1;
     constexpr auto fParseRgbColor = [](const std::string &value) -> uint32_t {
@@ -263,6 +396,70 @@ Core::hresult TextTrackImplementation::Configure(PluginHost::IShell *shell) {
     if (mPluginConfig.StandardSocket.IsSet()) {
         standardSocket = mPluginConfig.StandardSocket;
     }
+    if (mPluginConfig.DataQueueCapacity.IsSet() && mPluginConfig.DataQueueCapacity.Value() > 0) {
+        mSessionSettings.dataQueueCapacity = mPluginConfig.DataQueueCapacity.Value();
+    }
+    if (mPluginConfig.DataQueueOverflow.IsSet()) {
+        const std::string overflow = mPluginConfig.DataQueueOverflow;
+        if (overflow == "block") {
+            mSessionSettings.dataQueueOverflow = DataQueueOverflow::BLOCK;
+        } else if (overflow == "dropoldest") {
+            mSessionSettings.dataQueueOverflow = DataQueueOverflow::DROP_OLDEST;
+        } else if (overflow == "reject") {
+            mSessionSettings.dataQueueOverflow = DataQueueOverflow::REJECT;
+        } else {
+            TRACE(Trace::Error, (_T("Unknown dataqueueoverflow '%s', using default"), overflow.c_str()));
+        }
+    }
+    if (mPluginConfig.SharedMemorySize.IsSet() && mPluginConfig.SharedMemorySize.Value() > 0) {
+        mSessionSettings.sharedMemorySize = mPluginConfig.SharedMemorySize.Value();
+    }
+    if (mPluginConfig.CcPreFilter.IsSet()) {
+        mSessionSettings.ccPreFilter = mPluginConfig.CcPreFilter.Value();
+    }
+    if (mPluginConfig.BatchedSocket.IsSet()) {
+        mSessionSettings.batchedSocket = mPluginConfig.BatchedSocket.Value();
+    }
+    if (mPluginConfig.MaxDataLatency.IsSet()) {
+        mSessionSettings.maxDataLatency = std::chrono::milliseconds(mPluginConfig.MaxDataLatency.Value());
+    }
+    if (mPluginConfig.SidecarDirectory.IsSet()) {
+        mSidecarDirectory = mPluginConfig.SidecarDirectory.Value();
+    }
+    if (mPluginConfig.PipelinedRendering.IsSet()) {
+        mSessionSettings.pipelinedRendering = mPluginConfig.PipelinedRendering.Value();
+    }
+    if (mPluginConfig.RenderPolicy.IsSet() && !mPluginConfig.RenderPolicy.Value().empty()
+        && !parseRenderThreadPolicy(mPluginConfig.RenderPolicy.Value(), mSessionSettings.renderThread.policy)) {
+        TRACE(Trace::Error, (_T("Unknown render thread policy '%s', keeping the default"), mPluginConfig.RenderPolicy.Value().c_str()));
+    }
+    if (mPluginConfig.RenderPriority.IsSet()) {
+        mSessionSettings.renderThread.priority = mPluginConfig.RenderPriority.Value();
+    }
+    if (mPluginConfig.RenderNice.IsSet()) {
+        mSessionSettings.renderThread.nice = mPluginConfig.RenderNice.Value();
+    }
+    if (mPluginConfig.RenderAffinity.IsSet()) {
+        mSessionSettings.renderThread.affinityMask = mPluginConfig.RenderAffinity.Value();
+    }
+    if (mPluginConfig.RenderWorkers.IsSet() && mPluginConfig.RenderWorkers.Value() > 0 && !mRenderWorkers) {
+        // More workers than cores would only take turns
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        try {
+            const std::chrono::milliseconds timerSlack(mPluginConfig.TimerSlack.IsSet() ? mPluginConfig.TimerSlack.Value() : 0);
+            mRenderWorkers = std::make_unique<RenderWorkerPool>(std::min<unsigned>(mPluginConfig.RenderWorkers.Value(), cores), timerSlack,
+                                                                mSessionSettings.renderThread);
+            mSessionSettings.renderWorkers = mRenderWorkers.get();
+            if (mPluginConfig.SessionCpuBudget.IsSet()) {
+                mSessionSettings.renderCpuBudget = std::chrono::milliseconds(mPluginConfig.SessionCpuBudget.Value());
+            }
+        } catch (const std::exception &e) {
+            TRACE(Trace::Error, (_T("Cannot create render workers, sessions get a thread each: %s"), e.what()));
+        }
+    }
+    if (!mRenderWorkers && mPluginConfig.SessionCpuBudget.IsSet() && mPluginConfig.SessionCpuBudget.Value() > 0) {
+        TRACE(Trace::Error, (_T("sessioncpubudget only applies with render workers, sessions get no budget")));
+    }
     // Displayname falls back to environment
     if (standardDisplay.empty()) {
         if (const char *env_display = getenv("WAYLAND_DISPLAY")) {
@@ -306,7 +503,11 @@ Core::hresult TextTrackImplementation::Configure(PluginHost::IShell *shell) {
         }
 #endif
         std::unique_lock lock{mSessionsMutex};
-        auto compatible = std::make_unique<RenderSession>(mConfiguration, standardDisplay, standardSocket);
+        // The main player's subtitles go first and are never held back for others
+        RenderSessionSettings standardSettings = mSessionSettings;
+        standardSettings.renderFirst = true;
+        standardSettings.renderCpuBudget = std::chrono::milliseconds::zero();
+        auto compatible = std::make_shared<RenderSession>(mConfiguration, standardSettings, standardDisplay, standardSocket);
         TRACE(Trace::Information, (_T("starts standard session on %s with %s"), standardDisplay.c_str(), standardSocket.c_str()));
         compatible->start();
         // No timeout for this session
@@ -848,7 +1049,7 @@ Core::hresult TextTrackImplementation::OpenSession(const std::string &iDisplayNa
             return Core::ERROR_GENERAL;
         }
 #endif
-        auto newSession = std::make_unique<RenderSession>(mConfiguration, iDisplayName);
+        auto newSession = std::make_shared<RenderSession>(mConfiguration, mSessionSettings, iDisplayName);
         newSession->start();
         mSessions.emplace(oSessionId, SessionInfo{std::move(newSession)});
     } catch (const std::exception &e) {
@@ -913,29 +1114,111 @@ Core::hresult TextTrackImplementation::UnMuteSession(uint32_t iSessionId) {
     return Core::ERROR_GENERAL;
 }
 
+std::shared_ptr<RenderSession> TextTrackImplementation::FindSession(uint32_t sessionId) const {
+    std::unique_lock lock{mSessionsMutex};
+    auto ses_it = mSessions.find(sessionId);
+    return ses_it != mSessions.end() ? ses_it->second.session : nullptr;
+}
+
 Core::hresult TextTrackImplementation::SendSessionData(uint32_t sessionId, DataType type, int64_t displayOffsetMs, const string &data) {
-    constexpr auto fTypeConvert = [](DataType type_) -> RenderSession::DataType {
-        switch (type_) {
-            case DataType::PES:
-                return RenderSession::DataType::PES;
-            case DataType::TTML:
-                return RenderSession::DataType::TTML;
-            case DataType::CC:
-                return RenderSession::DataType::CC;
-            case DataType::WEBVTT:
-                return RenderSession::DataType::WEBVTT;
+    // A full queue may make us wait, which must not hold up calls for other sessions
+    const auto session = FindSession(sessionId);
+    if (!session) {
+        return Core::ERROR_GENERAL;
+    }
+    if (!isCompressionSupported(convertCompression(type))) {
+        return Core::ERROR_NOT_SUPPORTED;
+    }
+    if (type == DataType::PES && !session->wantsPesData(data.data(), data.size())) {
+        // Another channel of the same stream, not worth a copy
+        return Core::ERROR_NONE;
+    }
+    auto buffer = createDataBuffer(*session, type, data);
+    if (!buffer) {
+        TRACE(Trace::Error, (_T("Malformed data for session %u"), sessionId));
+        return Core::ERROR_BAD_REQUEST;
+    }
+    // displayOffsetMs will not be valid for all types of session
+    return convertSendResult(session->sendData(convertDataType(type), std::move(buffer), displayOffsetMs, convertCompression(type)));
+}
+
+#if ITEXTTRACK_VERSION >= 4
+Core::hresult TextTrackImplementation::OpenSessionSharedMemory(uint32_t sessionId, string &name) {
+    std::unique_lock lock{mSessionsMutex};
+    auto ses_it = mSessions.find(sessionId);
+    if (ses_it == mSessions.end()) {
+        return Core::ERROR_GENERAL;
+    }
+    name = ses_it->second.session->getSharedMemoryName();
+    if (name.empty()) {
+        name = "/texttrack-session-" + std::to_string(sessionId);
+        if (!ses_it->second.session->openSharedMemory(name)) {
+            name.clear();
+            return Core::ERROR_GENERAL;
         }
-        return RenderSession::DataType::CC; // Compiler says we need to return something
-    };
+    }
+    return Core::ERROR_NONE;
+}
+
+Core::hresult TextTrackImplementation::SetSessionSidecarFile(uint32_t sessionId, const string &path, int64_t displayOffsetMs) {
+    if (mSidecarDirectory.empty()) {
+        TRACE(Trace::Error, (_T("Sidecar files are disabled, no sidecardirectory is configured")));
+        return Core::ERROR_UNAVAILABLE;
+    }
+    // Indexing reads the whole file, so do it before taking mSessionsMutex
+    auto file = std::make_shared<SidecarFile>(path);
+    if (!file->open(mSidecarDirectory)) {
+        TRACE(Trace::Error, (_T("Cannot use sidecar file %s"), path.c_str()));
+        return Core::ERROR_OPENING_FAILED;
+    }
     std::unique_lock lock{mSessionsMutex};
     auto ses_it = mSessions.find(sessionId);
     if (ses_it == mSessions.end()) {
         return Core::ERROR_GENERAL;
     }
-    // displayOffsetMs will not be valid for all types of session
-    ses_it->second.session->sendData(fTypeConvert(type), data, displayOffsetMs);
+    ses_it->second.session->setSidecarFile(std::move(file), displayOffsetMs);
+    return Core::ERROR_NONE;
+}
+
+Core::hresult TextTrackImplementation::SendSessionDataBatch(uint32_t sessionId, const std::vector<SessionDataEntry> &entries) {
+    const auto sessionPtr = FindSession(sessionId);
+    if (!sessionPtr) {
+        return Core::ERROR_GENERAL;
+    }
+    auto &session = *sessionPtr;
+    // Copy each payload once, straight behind its packet header
+    std::vector<RenderSession::DataEntry> batch;
+    batch.reserve(entries.size());
+    for (const auto &entry : entries) {
+        const auto compression = convertCompression(entry.type);
+        if (!isCompressionSupported(compression)) {
+            return Core::ERROR_NOT_SUPPORTED;
+        }
+        if (entry.type == DataType::PES && !session.wantsPesData(entry.data.data(), entry.data.size())) {
+            continue;
+        }
+        auto buffer = createDataBuffer(session, entry.type, entry.data);
+        if (!buffer) {
+            TRACE(Trace::Error, (_T("Malformed data for session %u"), sessionId));
+            return Core::ERROR_BAD_REQUEST;
+        }
+        batch.push_back({convertDataType(entry.type), std::move(buffer), entry.displayOffsetMs, compression});
+    }
+    return convertSendResult(session.sendDataBatch(std::move(batch)));
+}
+
+Core::hresult TextTrackImplementation::GetSessionStatistics(uint32_t sessionId, string &statistics) const {
+    std::unique_lock lock{mSessionsMutex};
+    auto ses_it = mSessions.find(sessionId);
+    if (ses_it == mSessions.end()) {
+        return Core::ERROR_GENERAL;
+    }
+    JsonSessionStatistics json;
+    json = ses_it->second.session->getStatistics();
+    json.ToString(statistics);
     return Core::ERROR_NONE;
 }
+#endif
 
 Core::hresult TextTrackImplementation::SendSessionTimestamp(uint32_t iSessionId, uint64_t iMediaTimestampMs) {
     std::unique_lock lock{mSessionsMutex};
@@ -1019,10 +1302,7 @@ Core::hresult TextTrackImplementation::SetSessionClosedCaptionsService(uint32_t
 
 // CC style settings in the format that subttxrend wants them
 void TextTrackImplementation::ApplyClosedCaptionsStyle(RenderSession &session, const SubttxClosedCaptionsStyle &style) {
-    if (!session.hasCustomCcStyling()) {
-        session.applyCcStyling(style);
-        session.refreshClosedCaptionPreview();
-    }
+    session.applyCcStyling(style);
 }
 
 void TextTrackImplementation::ApplyClosedCaptionsStyle(const ClosedCaptionsStyle &style) {
@@ -1068,13 +1348,11 @@ Core::hresult TextTrackImplementation::SetSessionTTMLSelection(uint32_t iSession
     auto ses_it = mSessions.find(iSessionId);
     if (ses_it != mSessions.end()) {
         ses_it->second.session->selectTtmlService(1920, 1080);
-        if (!ses_it->second.session->hasCustomTtmlStyling()) {
-            string style;
-            std::unique_lock lockCfg{mConfigMutex};
-            ReadTtmlStyleOverrides(style);
-            if (!style.empty()) {
-                ses_it->second.session->applyTtmlStyling(style);
-            }
+        string style;
+        std::unique_lock lockCfg{mConfigMutex};
+        ReadTtmlStyleOverrides(style);
+        if (!style.empty()) {
+            ses_it->second.session->applyTtmlStyling(style);
         }
         return Core::ERROR_NONE;
     }
@@ -1083,10 +1361,9 @@ Core::hresult TextTrackImplementation::SetSessionTTMLSelection(uint32_t iSession
 
 #if ITEXTTRACK_VERSION >= 2
 Core::hresult TextTrackImplementation::ApplyCustomTtmlStyleOverridesToSession(uint32_t iSessionId, const string &styling) {
-    std::unique_lock lock{mSessionsMutex};
-    auto ses_it = mSessions.find(iSessionId);
-    if (ses_it != mSessions.end()) {
-        if (ses_it->second.session->setCustomTtmlStyling(styling)) {
+    const auto session = FindSession(iSessionId);
+    if (session) {
+        if (session->setCustomTtmlStyling(styling)) {
             return Core::ERROR_NONE;
         } else {
             return Core::ERROR_NOT_SUPPORTED;
@@ -1099,9 +1376,7 @@ Core::hresult TextTrackImplementation::ApplyCustomTtmlStyleOverridesToSession(ui
 void TextTrackImplementation::ApplyTtmlStyleOverrides(const string &style) {
     // Apply to all TTML sessions, unless they already have a style override
     for (const auto &sess : mSessions) {
-        if (!sess.second.session->hasCustomTtmlStyling()) {
-            sess.second.session->applyTtmlStyling(style);
-        }
+        sess.second.session->applyTtmlStyling(style);
     }
 }
 
@@ -34,6 +34,7 @@
 #include <subttxrend/ctrl/Configuration.hpp>
 #include <subttxrend/ctrl/Options.hpp>
 
+#include "RenderSession.h"
 #include "TextTrackConfiguration.h"
 
 // Sanity check
@@ -44,9 +45,6 @@
 namespace WPEFramework {
 namespace Plugin {
 
-class RenderSession;
-class SubttxClosedCaptionsStyle;
-
 class TextTrackImplementation : public Exchange::ITextTrack,
                                 public Exchange::ITextTrackClosedCaptionsStyle,
                                 public Exchange::IConfiguration
@@ -114,6 +112,12 @@ public:
     Core::hresult MuteSession(uint32_t sessionId) override;
     Core::hresult UnMuteSession(uint32_t sessionId) override;
     Core::hresult SendSessionData(uint32_t sessionId, DataType type, int64_t displayOffsetMs, const string &data) override;
+#if ITEXTTRACK_VERSION >= 4
+    Core::hresult OpenSessionSharedMemory(uint32_t sessionId, string &name) override;
+    Core::hresult SetSessionSidecarFile(uint32_t sessionId, const string &path, int64_t displayOffsetMs) override;
+    Core::hresult SendSessionDataBatch(uint32_t sessionId, const std::vector<SessionDataEntry> &entries) override;
+    Core::hresult GetSessionStatistics(uint32_t sessionId, string &statistics) const override;
+#endif
     Core::hresult SendSessionTimestamp(uint32_t sessionId, uint64_t mediaTimestampMs) override;
     Core::hresult ApplyCustomClosedCaptionsStyleToSession(uint32_t sessionId, const ClosedCaptionsStyle &style) override;
     Core::hresult SetPreviewText(uint32_t sessionId, const std::string &text) override;
@@ -176,12 +180,17 @@ private:
     // Call with mSessionsMutex acquired
     void ApplyTtmlStyleOverrides(const string &style);
     void RaiseOnTtmlStyleOverridesChanged(const string &style);
+    // Takes mSessionsMutex only for the lookup; nullptr if there is no such session
+    std::shared_ptr<RenderSession> FindSession(uint32_t sessionId) const;
 
     struct SessionInfo {
-        std::unique_ptr<RenderSession> session;
+        // Shared, so that calls that may wait on the session can do so without mSessionsMutex
+        std::shared_ptr<RenderSession> session;
     };
     subttxrend::ctrl::Options mOptions;
     subttxrend::ctrl::Configuration mConfiguration;
+    // Shared by the sessions if configured, so it has to outlive them
+    std::unique_ptr<RenderWorkerPool> mRenderWorkers;
     // Acquire mSessionsMutex before mConfigMutex. Acquire mConfigMutex before mNotificationMutex.
     mutable std::mutex mSessionsMutex;
     // Protected by mSessionsMutex
@@ -209,6 +218,10 @@ private:
 
     // Parsing WPE plugin JSON configuration
     TextTrackConfiguration mPluginConfig;
+    // Settings for new sessions, from mPluginConfig
+    RenderSessionSettings mSessionSettings;
+    // Where sidecar files may be opened from, empty for nowhere; from mPluginConfig
+    std::string mSidecarDirectory;
 
 #if TEXTTRACK_WITH_RDKSHELL
     // We might need the RDKShell on some devices in order to create a display
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Hierarchical timer wheel with millisecond ticks (after Varghese and Lauck), for timers that
+// are added and fired far more often than they are searched. The first level has a slot per
+// tick for the next 256 ms, the next two a slot per 256 ms and per 16 s, and timers further
+// out wait in a list. Higher level slots are moved down a level as time reaches them.
+// Timers never fire early, and late by less than a tick plus however late advance is called.
+// Not thread safe.
+template <typename T>
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimerWheel() : mCurrentTick(floorTick(Clock::now())) {
+    }
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    void add(Clock::time_point dueTime, T value) {
+        place(Entry{dueTime, ceilTick(dueTime), std::move(value)});
+        ++mCount;
+    }
+
+    // Removes all timers whose value matches
+    template <typename Match>
+    void removeIf(Match match) {
+        const auto removeFrom = [this, &match](std::vector<Entry> &slot) {
+            const auto end = std::remove_if(slot.begin(), slot.end(), [&match](const Entry &entry) { return match(entry.value); });
+            mCount -= slot.end() - end;
+            slot.erase(end, slot.end());
+        };
+        removeFrom(mPastDue);
+        removeFrom(mOverflow);
+        for (auto &slot : mLevel0) {
+            removeFrom(slot);
+        }
+        for (auto &level : mUpperLevels) {
+            for (auto &slot : level) {
+                removeFrom(slot);
+            }
+        }
+    }
+
+    // Calls expire(dueTime, value) for every timer that is due at now, and forgets it
+    template <typename Expire>
+    void advance(Clock::time_point now, Expire expire) {
+        const int64_t nowTick = floorTick(now);
+        while (mCurrentTick < nowTick) {
+            if (mCount == 0) {
+                mCurrentTick = nowTick;
+                break;
+            }
+            const int64_t tick = ++mCurrentTick;
+            if ((tick & ((int64_t{1} << LEVEL2_SHIFT) - 1)) == 0) {
+                cascade(mUpperLevels[1][(tick >> LEVEL2_SHIFT) & UPPER_MASK]);
+                cascade(mOverflow);
+            }
+            if ((tick & LEVEL0_MASK) == 0) {
+                cascade(mUpperLevels[0][(tick >> LEVEL1_SHIFT) & UPPER_MASK]);
+            }
+            fire(mLevel0[tick & LEVEL0_MASK], expire);
+        }
+        // Including any that cascading found due at the current tick
+        fire(mPastDue, expire);
+    }
+
+    // When the earliest timer is due, or time_point::max() if there are none
+    Clock::time_point getNextDueTime() const {
+        // The first timers of each level, as a higher level can hold earlier timers than
+        // the level below once time has moved on since they were added
+        Clock::time_point next = std::min(earliest(mPastDue), earliest(mOverflow));
+        for (int64_t tick = mCurrentTick + 1; tick != mCurrentTick + LEVEL0_SLOTS; ++tick) {
+            if (!mLevel0[tick & LEVEL0_MASK].empty()) {
+                next = std::min(next, earliest(mLevel0[tick & LEVEL0_MASK]));
+                break;
+            }
+        }
+        const std::array<unsigned, 2> shifts{LEVEL1_SHIFT, LEVEL2_SHIFT};
+        for (std::size_t level = 0; level != mUpperLevels.size(); ++level) {
+            const int64_t currentBlock = mCurrentTick >> shifts[level];
+            for (int64_t block = currentBlock + 1; block != currentBlock + UPPER_SLOTS; ++block) {
+                if (!mUpperLevels[level][block & UPPER_MASK].empty()) {
+                    next = std::min(next, earliest(mUpperLevels[level][block & UPPER_MASK]));
+                    break;
+                }
+            }
+        }
+        return next;
+    }
+
+    bool empty() const {
+        return mCount == 0;
+    }
+private:
+    static constexpr unsigned LEVEL1_SHIFT = 8;
+    static constexpr unsigned LEVEL2_SHIFT = 14;
+    static constexpr int64_t LEVEL0_SLOTS = int64_t{1} << LEVEL1_SHIFT;
+    static constexpr int64_t LEVEL0_MASK = LEVEL0_SLOTS - 1;
+    static constexpr int64_t UPPER_SLOTS = int64_t{1} << (LEVEL2_SHIFT - LEVEL1_SHIFT);
+    static constexpr int64_t UPPER_MASK = UPPER_SLOTS - 1;
+
+    struct Entry {
+        Clock::time_point dueTime;
+        int64_t tick;
+        T value;
+    };
+
+    static int64_t floorTick(Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+    static int64_t ceilTick(Clock::time_point time) {
+        return std::chrono::ceil<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+    static Clock::time_point earliest(const std::vector<Entry> &slot) {
+        Clock::time_point dueTime = Clock::time_point::max();
+        for (const auto &entry : slot) {
+            dueTime = std::min(dueTime, entry.dueTime);
+        }
+        return dueTime;
+    }
+
+    // Puts an entry on the lowest level that reaches its tick without wrapping around
+    void place(Entry entry) {
+        if (entry.tick <= mCurrentTick) {
+            mPastDue.push_back(std::move(entry));
+        } else if (entry.tick - mCurrentTick < LEVEL0_SLOTS) {
+            mLevel0[entry.tick & LEVEL0_MASK].push_back(std::move(entry));
+        } else if ((entry.tick >> LEVEL1_SHIFT) - (mCurrentTick >> LEVEL1_SHIFT) < UPPER_SLOTS) {
+            mUpperLevels[0][(entry.tick >> LEVEL1_SHIFT) & UPPER_MASK].push_back(std::move(entry));
+        } else if ((entry.tick >> LEVEL2_SHIFT) - (mCurrentTick >> LEVEL2_SHIFT) < UPPER_SLOTS) {
+            mUpperLevels[1][(entry.tick >> LEVEL2_SHIFT) & UPPER_MASK].push_back(std::move(entry));
+        } else {
+            mOverflow.push_back(std::move(entry));
+        }
+    }
+
+    void cascade(std::vector<Entry> &slot) {
+        if (slot.empty()) {
+            return;
+        }
+        std::vector<Entry> entries;
+        entries.swap(slot);
+        for (auto &entry : entries) {
+            place(std::move(entry));
+        }
+        // Hand the capacity back, unless placing refilled the slot
+        if (slot.empty()) {
+            entries.clear();
+            slot.swap(entries);
+        }
+    }
+
+    template <typename Expire>
+    void fire(std::vector<Entry> &slot, Expire &expire) {
+        mCount -= slot.size();
+        // expire may add timers, though never to a slot that is being fired
+        std::vector<Entry> entries;
+        entries.swap(slot);
+        for (auto &entry : entries) {
+            expire(entry.dueTime, std::move(entry.value));
+        }
+        entries.clear();
+        if (slot.empty()) {
+            slot.swap(entries);
+        }
+    }
+
+    int64_t mCurrentTick;
+    std::size_t mCount = 0;
+    std::array<std::vector<Entry>, LEVEL0_SLOTS> mLevel0;
+    std::array<std::array<std::vector<Entry>, UPPER_SLOTS>, 2> mUpperLevels;
+    // Added with a tick that had already passed
+    std::vector<Entry> mPastDue;
+    std::vector<Entry> mOverflow;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+// Decoding speed of decodeBase64 for PES payloads of typical sizes. Which path is measured is
+// decided when Base64.cpp is compiled: NEON on ARM, SSSE3 on x86 with -mssse3 in CMAKE_CXX_FLAGS,
+// the scalar code otherwise. Build once with and once without -mssse3 to compare them on x86.
+
+#include "../Base64.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace WPEFramework::Plugin;
+
+namespace {
+
+std::string encode(const std::vector<uint8_t> &bytes) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    std::size_t i = 0;
+    for (; i + 3 <= bytes.size(); i += 3) {
+        const uint32_t bits = bytes[i] << 16 | bytes[i + 1] << 8 | bytes[i + 2];
+        result += alphabet[bits >> 18 & 0x3f];
+        result += alphabet[bits >> 12 & 0x3f];
+        result += alphabet[bits >> 6 & 0x3f];
+        result += alphabet[bits & 0x3f];
+    }
+    if (i != bytes.size()) {
+        const bool two = i + 2 == bytes.size();
+        const uint32_t bits = bytes[i] << 16 | (two ? bytes[i + 1] << 8 : 0);
+        result += alphabet[bits >> 18 & 0x3f];
+        result += alphabet[bits >> 12 & 0x3f];
+        result += two ? alphabet[bits >> 6 & 0x3f] : '=';
+        result += '=';
+    }
+    return result;
+}
+
+const char *pathName() {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    return "NEON";
+#elif defined(__SSSE3__)
+    return "SSSE3";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 random(1);
+    std::printf("decodeBase64, %s path\n", pathName());
+    std::printf("%10s %12s %12s\n", "bytes", "ns/call", "MB/s");
+    // A single teletext PES packet, a DVB subtitle page, and a large batch
+    for (const std::size_t size : {184u, 1472u, 4096u, 65536u}) {
+        std::vector<uint8_t> bytes(size);
+        for (auto &byte : bytes) {
+            byte = static_cast<uint8_t>(random());
+        }
+        const std::string text = encode(bytes);
+        subttxrend::common::DataBuffer output;
+        output.reserve(size);
+        if (!decodeBase64(text.data(), text.size(), output) || output.size() != size ||
+            !std::equal(bytes.begin(), bytes.end(), reinterpret_cast<const uint8_t *>(output.data()))) {
+            std::printf("decodeBase64 got %zu bytes wrong\n", size);
+            return 1;
+        }
+        const double ns = Benchmark::nsPerRun([&](std::size_t) {
+            output.clear();
+            decodeBase64(text.data(), text.size(), output);
+            return output.size();
+        });
+        std::printf("%10zu %12.1f %12.1f\n", size, ns, Benchmark::megabytesPerSecond(size, ns));
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+namespace WPEFramework {
+namespace Plugin {
+namespace Benchmark {
+
+// Runs work until at least minTime has passed and returns the average time of one run in ns.
+// work gets the run index; whatever it returns is kept alive so the call is not optimised away.
+template <typename Work>
+double nsPerRun(Work &&work, std::chrono::milliseconds minTime = std::chrono::milliseconds(500)) {
+    using Clock = std::chrono::steady_clock;
+    volatile std::size_t sink = 0;
+    std::size_t runs = 0;
+    const auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    do {
+        // Read the clock now and then only, it costs more than some of the work
+        for (std::size_t i = 0; i != 64; ++i) {
+            sink = sink + static_cast<std::size_t>(work(runs++));
+        }
+        elapsed = Clock::now() - start;
+    } while (elapsed < minTime);
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(runs);
+}
+
+// Megabytes (10^6 bytes) per second for bytes handled in ns
+inline double megabytesPerSecond(std::size_t bytes, double ns) {
+    return static_cast<double>(bytes) * 1000.0 / ns;
+}
+
+} // namespace Benchmark
+} // namespace Plugin
+} // namespace WPEFramework
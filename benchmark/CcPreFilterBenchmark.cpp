@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+// What CcPreFilter saves: a synthetic caption stream (CEA-608 on both fields with control codes
+// sent twice, alone or with CEA-708 alongside as ATSC carries it in 20 triplets per frame) is
+// filtered frame by frame, the way CC data arrives. The bytes left and the time a decoder spends on them are printed. The
+// decoder is a model of how a CEA-608/708 decoder walks the triplets, not subttxrend-cc itself,
+// which needs a display; it also checks that both streams decode to the same commands.
+
+#include "../CcPreFilter.h"
+#include "Benchmark.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace WPEFramework::Plugin;
+
+namespace {
+
+constexpr std::size_t FRAMES = 30 * 60 * 10;
+
+uint8_t withOddParity(uint8_t byte) {
+    return __builtin_parity(byte) ? byte : byte | 0x80;
+}
+
+void addTriplet(std::vector<uint8_t> &stream, uint8_t header, uint8_t first, uint8_t second) {
+    stream.push_back(header);
+    stream.push_back(first);
+    stream.push_back(second);
+}
+
+// One field of CEA-608: mostly padding, otherwise characters, or a control code in two frames in a row
+class Field608 {
+public:
+    explicit Field608(uint8_t type) : mType(type) {}
+    void addFrame(std::mt19937 &random, std::vector<uint8_t> &stream) {
+        std::uniform_int_distribution<int> percent(0, 99);
+        uint8_t first = 0;
+        uint8_t second = 0;
+        if (mRepeat != 0) {
+            first = mRepeat >> 8;
+            second = mRepeat & 0xff;
+            mRepeat = 0;
+        } else {
+            const int kind = percent(random);
+            if (kind < 40) {
+                // Padding
+            } else if (kind < 75) {
+                first = static_cast<uint8_t>(0x20 + random() % 0x5f);
+                second = static_cast<uint8_t>(0x20 + random() % 0x5f);
+            } else {
+                // Preamble address, mid-row and miscellaneous control codes
+                first = static_cast<uint8_t>(0x10 + random() % 0x10);
+                second = static_cast<uint8_t>(0x20 + random() % 0x60);
+                mRepeat = static_cast<uint16_t>(first << 8 | second);
+            }
+        }
+        uint8_t a = withOddParity(first);
+        uint8_t b = withOddParity(second);
+        // An occasional bit error
+        if (percent(random) == 0) {
+            a ^= 0x01;
+        }
+        addTriplet(stream, static_cast<uint8_t>(0xf8 | 0x04 | mType), a, b);
+    }
+private:
+    const uint8_t mType;
+    uint16_t mRepeat = 0;
+};
+
+std::vector<uint8_t> makeStream(std::mt19937 &random, std::size_t tripletsPerFrame) {
+    std::vector<uint8_t> stream;
+    Field608 field1(0);
+    Field608 field2(1);
+    for (std::size_t frame = 0; frame != FRAMES; ++frame) {
+        field1.addFrame(random, stream);
+        field2.addFrame(random, stream);
+        // CEA-708: a packet start, some data and DTVCC padding
+        for (std::size_t i = 2; i < tripletsPerFrame; ++i) {
+            const bool valid = random() % 4 == 0;
+            addTriplet(stream, static_cast<uint8_t>(0xf8 | (valid ? 0x04 : 0) | (i == 2 ? 3 : 2)), static_cast<uint8_t>(random()),
+                       static_cast<uint8_t>(random()));
+        }
+    }
+    return stream;
+}
+
+// What a decoder does per triplet: check cc_valid and parity, look through padding, skip the
+// second copy of a control code, and act on the rest. Returns a checksum of what it acted on.
+class DecoderModel {
+public:
+    uint64_t process(const uint8_t *data, std::size_t size) {
+        for (std::size_t i = 0; i + 3 <= size; i += 3) {
+            const uint8_t type = data[i] & 0x03;
+            if (type > 1) {
+                if (data[i] & 0x04) {
+                    act(0x708, static_cast<uint16_t>(data[i + 1] << 8 | data[i + 2]));
+                }
+                continue;
+            }
+            if ((data[i] & 0x04) == 0) {
+                continue;
+            }
+            const uint8_t first = data[i + 1] & 0x7f;
+            const uint8_t second = data[i + 2] & 0x7f;
+            if (first == 0 && second == 0) {
+                continue;
+            }
+            uint16_t &last = mLastControl[type];
+            if (first >= 0x10 && first < 0x20) {
+                if (!__builtin_parity(data[i + 1]) || !__builtin_parity(data[i + 2])) {
+                    continue;
+                }
+                const uint16_t control = static_cast<uint16_t>(first << 8 | second);
+                if (control == last) {
+                    last = 0;
+                    continue;
+                }
+                last = control;
+                act(type, control);
+            } else {
+                last = 0;
+                act(type, static_cast<uint16_t>(first << 8 | second));
+            }
+        }
+        return mChecksum;
+    }
+private:
+    void act(uint32_t kind, uint16_t value) {
+        mChecksum = (mChecksum ^ (kind << 16 | value)) * 0x100000001b3ull;
+    }
+
+    uint16_t mLastControl[2] = {0, 0};
+    uint64_t mChecksum = 0xcbf29ce484222325ull;
+};
+
+uint64_t decodeFrames(const std::vector<std::vector<uint8_t>> &frames) {
+    DecoderModel decoder;
+    uint64_t checksum = 0;
+    for (const auto &frame : frames) {
+        checksum = decoder.process(frame.data(), frame.size());
+    }
+    return checksum;
+}
+
+// Returns false if the filtered stream decodes differently
+bool measure(const char *name, std::size_t tripletsPerFrame) {
+    std::mt19937 random(1);
+    const std::vector<uint8_t> stream = makeStream(random, tripletsPerFrame);
+    const std::size_t frameSize = tripletsPerFrame * 3;
+
+    std::vector<std::vector<uint8_t>> rawFrames;
+    std::vector<std::vector<uint8_t>> filteredFrames;
+    std::vector<uint8_t> output(frameSize + CcPreFilter::MAX_GROWTH);
+    CcPreFilter filter;
+    std::size_t filteredBytes = 0;
+    for (std::size_t offset = 0; offset != stream.size(); offset += frameSize) {
+        rawFrames.emplace_back(stream.begin() + offset, stream.begin() + offset + frameSize);
+        const std::size_t size = filter.filter(stream.data() + offset, frameSize, output.data());
+        filteredBytes += size;
+        // Like the session, which queues nothing when nothing is left
+        if (size != 0) {
+            filteredFrames.emplace_back(output.begin(), output.begin() + size);
+        }
+    }
+    if (decodeFrames(rawFrames) != decodeFrames(filteredFrames)) {
+        std::printf("%s: the filtered stream decodes differently\n", name);
+        return false;
+    }
+
+    const double filterNs = Benchmark::nsPerRun([&](std::size_t run) {
+        CcPreFilter timedFilter;
+        const std::size_t offset = run % FRAMES * frameSize;
+        return timedFilter.filter(stream.data() + offset, frameSize, output.data());
+    });
+    const double rawNs = Benchmark::nsPerRun([&](std::size_t) { return decodeFrames(rawFrames); }) / FRAMES;
+    const double filteredNs = Benchmark::nsPerRun([&](std::size_t) { return decodeFrames(filteredFrames); }) / FRAMES;
+
+    std::printf("%s, %zu frames of %zu triplets\n", name, FRAMES, tripletsPerFrame);
+    std::printf("  bytes:             %zu -> %zu (%.0f%%)\n", stream.size(), filteredBytes, 100.0 * filteredBytes / stream.size());
+    std::printf("  packets queued:    %zu -> %zu\n", rawFrames.size(), filteredFrames.size());
+    std::printf("  filter per frame:  %.1f ns\n", filterNs);
+    std::printf("  decode per frame:  %.1f ns -> %.1f ns (%.0f%%)\n", rawNs, filteredNs, 100.0 * filteredNs / rawNs);
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const bool same = measure("CEA-608", 2) && measure("CEA-608 and CEA-708", 20);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ *  If not stated otherwise in this file or this component's LICENSE
+ *  file the following copyright and licenses apply:
+ *
+ *  Copyright 2024 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+// Receive throughput of BatchSocketSource against socksrc::UnixSocketSource: a sender pushes
+// packets of a few sizes, one per datagram, through the session socket as fast as the source
+// takes them, and the time until the last one reached the receiver is measured. The resident
+// set size once the socket is idle again shows what the receive slots keep hold of.
+
+#include "../BatchSocketSource.h"
+#include "Benchmark.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <subttxrend/socksrc/UnixSocketSourceFactory.hpp>
+#include <vector>
+
+using namespace WPEFramework::Plugin;
+
+namespace {
+
+// type, counter, size, channel id
+constexpr std::size_t PACKET_HEADER_SIZE = 16;
+
+class CountingReceiver : public BatchPacketReceiver {
+public:
+    void addBuffer(subttxrend::common::DataBufferPtr /*buffer*/) override {
+        std::lock_guard<std::mutex> lock{mMutex};
+        count(1);
+    }
+    void addBuffers(std::vector<subttxrend::common::DataBufferPtr> &buffers) override {
+        std::lock_guard<std::mutex> lock{mMutex};
+        count(buffers.size());
+        buffers.clear();
+    }
+    void onStreamBroken() override {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mBroken = true;
+        mDone.notify_all();
+    }
+    // Waits for packets in total; false if the stream broke first
+    bool waitFor(std::size_t packets) {
+        std::unique_lock<std::mutex> lock{mMutex};
+        mDone.wait(lock, [&]() { return mBroken || mPackets >= packets; });
+        return !mBroken;
+    }
+private:
+    void count(std::size_t packets) {
+        mPackets += packets;
+        mDone.notify_all();
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    std::size_t mPackets = 0;
+    bool mBroken = false;
+};
+
+std::size_t residentKiB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::stoul(line.substr(6));
+        }
+    }
+    return 0;
+}
+
+// Sends count packets of payloadSize to path, one per datagram; UnixSocketSource binds in its own
+// thread, so keep trying until the socket is there. Returns the seconds until the receiver had them,
+// and the resident set size before the source is stopped.
+double run(subttxrend::socksrc::Source &source, const std::string &path, std::size_t payloadSize, std::size_t count, std::size_t &resident) {
+    CountingReceiver receiver;
+    source.start(&receiver);
+    struct sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    const int sender = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    while (connect(sender, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+        usleep(1000);
+    }
+    std::vector<char> packet(PACKET_HEADER_SIZE + payloadSize);
+    // Nothing parses the packets, so only the size word matters
+    const uint32_t header[4] = {0, 0, static_cast<uint32_t>(packet.size() - 12), 0};
+    std::memcpy(packet.data(), header, sizeof(header));
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != count; ++i) {
+        if (send(sender, packet.data(), packet.size(), 0) != static_cast<ssize_t>(packet.size())) {
+            std::perror("send");
+            break;
+        }
+    }
+    const bool complete = receiver.waitFor(count);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    ::close(sender);
+    // Give the source a moment to find the socket empty
+    usleep(20000);
+    resident = residentKiB();
+    source.stop();
+    return complete ? elapsed.count() : -1.0;
+}
+
+} // namespace
+
+int main() {
+    const std::string path = "/tmp/texttrack-socket-benchmark-" + std::to_string(getpid());
+    std::printf("%-18s %10s %10s %12s %10s %12s\n", "source", "bytes", "packets", "packets/s", "MB/s", "VmRSS KiB");
+    // A teletext PES packet, a DVB subtitle page, a large TTML segment
+    for (const std::size_t payloadSize : {184u, 1472u, 65536u}) {
+        const std::size_t count = payloadSize > 4096 ? 5000 : 100000;
+        for (const bool batched : {false, true}) {
+            DataBufferPool pool;
+            subttxrend::socksrc::SourcePtr source;
+            if (batched) {
+                source = std::make_unique<BatchSocketSource>(path, pool);
+            } else {
+                source = subttxrend::socksrc::UnixSocketSourceFactory().create(path);
+            }
+            std::size_t resident = 0;
+            const double seconds = run(*source, path, payloadSize, count, resident);
+            source.reset();
+            unlink(path.c_str());
+            if (seconds < 0) {
+                std::printf("%-18s stream broken\n", batched ? "BatchSocketSource" : "UnixSocketSource");
+                return 1;
+            }
+            std::printf("%-18s %10zu %10zu %12.0f %10.1f %12zu\n", batched ? "BatchSocketSource" : "UnixSocketSource", payloadSize, count,
+                        count / seconds, Benchmark::megabytesPerSecond(count * payloadSize, seconds * 1e9), resident);
+        }
+    }
+    return 0;
+}